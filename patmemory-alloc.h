@@ -0,0 +1,213 @@
+#ifndef PATMEMORY_ALLOC_H
+#define PATMEMORY_ALLOC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <sys/mman.h>
+#include "pattern-threadpool.h"
+
+// Slot storage for Memory and MemoryMT.
+//
+// A table is two arrays, control bytes and slots, that reach gigabytes for
+// large tables. BasicMemory's Alloc parameter decides where they come from
+// (std::allocator by default, HugePageAllocator for 2 MB pages), and
+// MemoryArray decides who touches them first.
+
+constexpr size_t kHugePageBytes = size_t(2) << 20;
+
+// Arrays this large are constructed by the pool rather than the calling thread.
+constexpr size_t kParallelTouchBytes = size_t(32) << 20;
+
+// Bytes per slice handed to one thread: whole huge pages, so no 2 MB page is
+// first touched by two threads.
+constexpr size_t kTouchSliceBytes = 4 * kHugePageBytes;
+
+enum class HugePages {
+    Transparent, // madvise(MADV_HUGEPAGE); the kernel backs the range with 2 MB pages when it can
+    Explicit     // MAP_HUGETLB from the reserved pool (vm.nr_hugepages), else as Transparent
+};
+
+// Allocator for BasicMemory's Alloc parameter, e.g.
+// BasicMemory<uint64_t, uint64_t, FixedKeyHash, HugePageAllocator<uint8_t>>.
+// Arrays of at least one huge page are mapped on a 2 MB boundary and backed
+// by huge pages, so random probes over a large table need one TLB entry per
+// 2 MB instead of per 4 KB. Smaller arrays come from the heap. Either way the
+// memory is zero-filled (zeroes_memory), which MemoryArray relies on to
+// leave all-zero slots unwritten.
+template<typename T, HugePages Mode = HugePages::Transparent>
+class HugePageAllocator {
+private:
+    static constexpr size_t kAlign = alignof(T) > alignof(std::max_align_t) ? alignof(T) : alignof(std::max_align_t);
+
+    static size_t round_up(size_t bytes, size_t to) { return (bytes + to - 1) & ~(to - 1); }
+
+    static void* map(size_t len) {
+        if constexpr (Mode == HugePages::Explicit) {
+            void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+                return p;
+        }
+        // Map one huge page more than needed and trim both ends to a 2 MB boundary.
+        size_t span = len + kHugePageBytes;
+        void* p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        char* raw = static_cast<char*>(p);
+        char* start = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(raw), kHugePageBytes));
+        if (start > raw)
+            munmap(raw, static_cast<size_t>(start - raw));
+        if (size_t tail = span - static_cast<size_t>(start - raw) - len; tail > 0)
+            munmap(start + len, tail);
+        madvise(start, len, MADV_HUGEPAGE); // fails harmlessly when THP is off
+        return start;
+    }
+
+public:
+    using value_type = T;
+    static constexpr bool zeroes_memory = true;
+    template<typename U> struct rebind { using other = HugePageAllocator<U, Mode>; };
+
+    HugePageAllocator() = default;
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U, Mode>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+        size_t bytes = n * sizeof(T);
+        if (bytes >= kHugePageBytes)
+            return static_cast<T*>(map(round_up(bytes, kHugePageBytes)));
+        void* p = std::aligned_alloc(kAlign, round_up(bytes > 0 ? bytes : 1, kAlign));
+        if (!p)
+            throw std::bad_alloc();
+        std::memset(p, 0, bytes);
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        size_t bytes = n * sizeof(T);
+        if (bytes >= kHugePageBytes)
+            munmap(p, round_up(bytes, kHugePageBytes));
+        else
+            std::free(p);
+    }
+
+    template<typename U>
+    bool operator==(const HugePageAllocator<U, Mode>&) const noexcept { return true; }
+};
+
+// Whether Alloc hands out zero-filled memory (declares zeroes_memory = true).
+template<typename Alloc>
+constexpr bool allocator_zeroes_memory() {
+    if constexpr (requires { Alloc::zeroes_memory; })
+        return Alloc::zeroes_memory;
+    else
+        return false;
+}
+
+// Fixed-size array of T from Alloc: the control bytes and slots of a table.
+// Unlike std::vector it does not construct its elements one by one on the
+// calling thread. An array of kParallelTouchBytes or more is constructed in
+// slices spread across the shared pool (ThreadPool::help_for, so it is safe
+// from a pool task), which shares out the page faults and places each page
+// near a thread that will probe it. With a zero-filling allocator, an array
+// whose initial element is all zero bytes is not written at all: the zero
+// pages already hold it, and each is faulted in by the first probe that
+// reaches it. That takes a trivially copyable T.
+template<typename T, typename Alloc>
+class MemoryArray {
+private:
+    using Allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+    [[no_unique_address]] Allocator alloc;
+    T* items = nullptr;
+    size_t count = 0;
+
+    static bool zero_bytes(const void* p) {
+        const unsigned char zero[sizeof(T)] = {};
+        return std::memcmp(p, zero, sizeof(T)) == 0;
+    }
+
+    // Calls init(begin, end) over the whole array, in slices on the pool if
+    // it is large and init cannot throw halfway.
+    template<typename Init>
+    void touch(Init init) {
+        if constexpr (std::is_nothrow_invocable_v<Init&, T*, T*>) {
+            if (count * sizeof(T) >= kParallelTouchBytes) {
+                size_t per = kTouchSliceBytes / sizeof(T) > 0 ? kTouchSliceBytes / sizeof(T) : 1;
+                ThreadPool::shared().help_for((count + per - 1) / per, [&](size_t s) {
+                    init(items + s * per, items + std::min(count, (s + 1) * per));
+                });
+                return;
+            }
+        }
+        init(items, items + count);
+    }
+
+    void allocate(size_t n) {
+        count = n;
+        items = n > 0 ? std::allocator_traits<Allocator>::allocate(alloc, n) : nullptr;
+    }
+
+    void release() noexcept {
+        if (!items)
+            return;
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            std::destroy_n(items, count);
+        std::allocator_traits<Allocator>::deallocate(alloc, items, count);
+        items = nullptr;
+    }
+
+public:
+    MemoryArray() = default;
+
+    // n default-constructed elements.
+    explicit MemoryArray(size_t n) {
+        allocate(n);
+        if constexpr (allocator_zeroes_memory<Allocator>() && std::is_trivially_copyable_v<T>) {
+            alignas(T) unsigned char probe[sizeof(T)] = {};
+            ::new (static_cast<void*>(probe)) T();
+            if (zero_bytes(probe))
+                return;
+        }
+        try {
+            touch([](T* begin, T* end) noexcept(std::is_nothrow_default_constructible_v<T>) {
+                std::uninitialized_value_construct(begin, end);
+            });
+        } catch (...) {
+            if (items)
+                std::allocator_traits<Allocator>::deallocate(alloc, items, count);
+            throw;
+        }
+    }
+
+    // n copies of fill, for byte arrays.
+    MemoryArray(size_t n, T fill) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        allocate(n);
+        if (allocator_zeroes_memory<Allocator>() && zero_bytes(&fill))
+            return;
+        touch([fill](T* begin, T* end) noexcept { std::uninitialized_fill(begin, end, fill); });
+    }
+
+    MemoryArray(const MemoryArray&) = delete;
+    MemoryArray& operator=(const MemoryArray&) = delete;
+    ~MemoryArray() { release(); }
+
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t bytes() const { return count * sizeof(T); }
+};
+
+#endif // PATMEMORY_ALLOC_H
@@ -1,3 +1,4 @@
+#include <cassert>
 #include <cstdint>
 #include <iostream>
 #include <cstring>
@@ -9,7 +10,9 @@
 #include <future>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <unordered_map>
+#include <algorithm>
 #include "pattern.h"
 #include "patmemory-mt.h"
 
@@ -57,11 +60,10 @@ int main() {
     // 3. Performance Test with Large Dataset:
     std::cout << "\n3. Performance Test with Large Dataset:" << std::endl;
     const size_t TEST_SIZE = 1000000; // 1M records for demonstration
-    MemoryMT<int> largeMem(TEST_SIZE);
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(1, 1000000);
-    
+    MemoryMT<int, FastKeyHash> largeMem(TEST_SIZE); // "key" + i collides under the pattern hash
+    // Each thread draws from its own generator; see pattern-bench.cpp for
+    // repeatable measurements with latency percentiles.
+
     // Concurrent insertion using multiple threads.
     size_t threadCount = std::thread::hardware_concurrency();
     if (threadCount == 0) threadCount = 4;
@@ -71,7 +73,9 @@ int main() {
     for (size_t t = 0; t < threadCount; ++t) {
         size_t start = t * itemsPerThread;
         size_t end = (t == threadCount - 1) ? TEST_SIZE : start + itemsPerThread;
-        insertThreads.emplace_back([&largeMem, start, end, &dis, &gen](){
+        insertThreads.emplace_back([&largeMem, start, end, t](){
+            std::mt19937 gen(static_cast<unsigned>(t + 1)); // per-thread RNG
+            std::uniform_int_distribution<> dis(1, 1000000);
             for (size_t i = start; i < end; ++i) {
                 std::string key = "key" + std::to_string(i);
                 largeMem.put(key, dis(gen));
@@ -85,26 +89,31 @@ int main() {
     std::cout << "Concurrent insert time: " << insert_duration.count() << " ms" << std::endl;
     std::cout << "Insert rate: " << (TEST_SIZE * 1000.0 / insert_duration.count()) << " records/sec" << std::endl;
 
-    // Concurrent lookup performance test:
-    size_t lookupCount = 10000;
+    // Concurrent lookup performance test: the lookups are split over the
+    // same threads rather than starting a thread per lookup.
+    size_t lookupCount = 1000000;
+    std::atomic<size_t> lookupHits(0);
+    std::vector<std::thread> lookupThreads;
     start_time = std::chrono::high_resolution_clock::now();
-    std::vector<std::future<int>> lookupFutures;
-    for (size_t i = 0; i < lookupCount; ++i) {
-        lookupFutures.push_back(std::async(std::launch::async, [&largeMem, &dis, &gen, TEST_SIZE](){
-            std::string key = "key" + std::to_string(dis(gen) % TEST_SIZE);
+    for (size_t t = 0; t < threadCount; ++t) {
+        lookupThreads.emplace_back([&largeMem, &lookupHits, t, threadCount, lookupCount, TEST_SIZE](){
+            std::mt19937 gen(static_cast<unsigned>(t + 101));
+            std::uniform_int_distribution<size_t> pick(0, TEST_SIZE - 1);
+            size_t hits = 0;
             int value;
-            largeMem.get(key, value);
-            return value;
-        }));
+            for (size_t i = t; i < lookupCount; i += threadCount)
+                hits += largeMem.get("key" + std::to_string(pick(gen)), value);
+            lookupHits += hits;
+        });
     }
-    for (auto &f : lookupFutures)
-        f.get();
+    for (auto &t : lookupThreads)
+        t.join();
     end_time = std::chrono::high_resolution_clock::now();
     auto lookup_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-    std::cout << "Concurrent lookup time (" << lookupCount << " random lookups): " 
-              << lookup_duration.count() << " μs" << std::endl;
-    std::cout << "Average lookup time: " << (lookup_duration.count() / lookupCount) 
-              << " μs/lookup" << std::endl;
+    std::cout << "Concurrent lookup time (" << lookupCount << " random lookups, " << lookupHits.load()
+              << " hits, " << threadCount << " threads): " << lookup_duration.count() << " μs" << std::endl;
+    std::cout << "Average lookup time: " << (lookup_duration.count() * 1000.0 / lookupCount)
+              << " ns/lookup" << std::endl;
     
     // 4. Edge Cases:
     std::cout << "\n4. Edge Cases:" << std::endl;
@@ -112,6 +121,278 @@ int main() {
     std::cout << "Empty key test: " << (edgeMem.put("", "empty") ? "success" : "failed") << std::endl;
     if (edgeMem.get("", value))
         std::cout << "Retrieved empty key value: " << value << std::endl;
-    
+
+    // 5. Shard Scaling Benchmark:
+    std::cout << "\n5. Shard Scaling Benchmark:" << std::endl;
+    const size_t scaleKeys = 20000;
+    const size_t opsPerThread = 200000;
+    std::vector<std::string> keys;
+    keys.reserve(scaleKeys);
+    // Keys over the hash alphabet spread best under the pattern hash.
+    std::mt19937 key_gen(7);
+    for (size_t i = 0; i < scaleKeys; ++i) {
+        std::string key(32, ' ');
+        for (char &c : key)
+            c = "*&1x"[key_gen() % 4];
+        keys.push_back(key);
+    }
+    size_t maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 4;
+    std::vector<size_t> threadCounts;
+    for (size_t n = 1; n < maxThreads; n *= 2)
+        threadCounts.push_back(n);
+    threadCounts.push_back(maxThreads);
+    for (size_t shardCount : {size_t(1), size_t(64)}) {
+        MemoryMT<int> scaleMem(scaleKeys, shardCount);
+        for (size_t i = 0; i < scaleKeys; ++i)
+            scaleMem.put(keys[i], static_cast<int>(i));
+        std::cout << "Shards: " << scaleMem.shard_count() << std::endl;
+        for (size_t threads : threadCounts) {
+            std::vector<std::thread> workers;
+            auto scale_start = std::chrono::steady_clock::now();
+            for (size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&scaleMem, &keys, t, opsPerThread]() {
+                    std::mt19937 local_gen(static_cast<unsigned>(t + 1)); // per-thread RNG
+                    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+                    int out = 0;
+                    for (size_t i = 0; i < opsPerThread; ++i) {
+                        const std::string &key = keys[pick(local_gen)];
+                        if (i % 5 == 0)
+                            scaleMem.put(key, static_cast<int>(i));
+                        else
+                            scaleMem.get(key, out);
+                    }
+                });
+            }
+            for (auto &w : workers)
+                w.join();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - scale_start;
+            std::cout << "  " << threads << " threads: "
+                      << (threads * opsPerThread / elapsed.count() / 1e6) << " Mops/sec (20% put)" << std::endl;
+        }
+    }
+
+    // 6. Optimistic Read Benchmark:
+    std::cout << "\n6. Optimistic Read Benchmark:" << std::endl;
+    // Two words per value so a read that overlapped a put could come back torn.
+    struct Checked {
+        uint64_t value;
+        uint64_t check; // ~value
+    };
+    MemoryMT<Checked> readMem(scaleKeys, 16);
+    for (size_t i = 0; i < scaleKeys; ++i)
+        readMem.put(keys[i], Checked{i, ~uint64_t(i)});
+    for (bool locked : {true, false}) {
+        std::cout << (locked ? "Shared lock:" : "Lock-free:") << std::endl;
+        for (size_t threads : threadCounts) {
+            std::atomic<size_t> torn(0);
+            std::vector<std::thread> workers;
+            auto read_start = std::chrono::steady_clock::now();
+            for (size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&readMem, &keys, &torn, locked, t, opsPerThread]() {
+                    std::mt19937 local_gen(static_cast<unsigned>(t + 1));
+                    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+                    Checked out{};
+                    size_t bad = 0;
+                    for (size_t i = 0; i < opsPerThread; ++i) {
+                        const std::string &key = keys[pick(local_gen)];
+                        if (i % 20 == 0) {
+                            readMem.put(key, Checked{i, ~uint64_t(i)});
+                        } else if (locked ? readMem.get_locked(key, out) : readMem.get(key, out)) {
+                            bad += out.check != ~out.value;
+                        }
+                    }
+                    torn += bad;
+                });
+            }
+            for (auto &w : workers)
+                w.join();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - read_start;
+            std::cout << "  " << threads << " threads: "
+                      << (threads * opsPerThread / elapsed.count() / 1e6) << " Mops/sec (5% put), torn reads: "
+                      << torn.load() << std::endl;
+        }
+    }
+    std::cout << "Stats: " << readMem.stats().to_json() << std::endl;
+
+    // 7. Cache Mode:
+    std::cout << "\n7. Cache Mode (MemoryGrowth::Evict, 16 shards, a quarter of the keys fit):" << std::endl;
+    std::vector<double> weights(scaleKeys);
+    for (size_t i = 0; i < scaleKeys; ++i)
+        weights[i] = 1.0 / static_cast<double>(i + 1); // Zipf, s = 1
+    std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+    std::vector<uint32_t> trace(opsPerThread);
+    for (auto &k : trace)
+        k = static_cast<uint32_t>(zipf(key_gen));
+    for (size_t threads : threadCounts) {
+        MemoryMT<int> cache(scaleKeys / 4, 16, MemoryGrowth::Evict);
+        std::atomic<size_t> hits(0);
+        std::vector<std::thread> workers;
+        auto cache_start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&cache, &keys, &trace, &hits, t, opsPerThread]() {
+                size_t local_hits = 0;
+                int out;
+                for (size_t i = 0; i < opsPerThread; ++i) {
+                    size_t k = trace[(i + t * 7919) % opsPerThread]; // each thread from its own offset
+                    if (cache.get(keys[k], out))
+                        ++local_hits;
+                    else
+                        cache.put(keys[k], static_cast<int>(k));
+                }
+                hits += local_hits;
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - cache_start;
+        MemoryStats cacheStats = cache.stats();
+        std::cout << "  " << threads << " threads: "
+                  << (threads * opsPerThread / elapsed.count() / 1e6) << " Mops/sec, hit rate "
+                  << (100.0 * cacheStats.hits / cacheStats.lookups) << "%, evictions: " << cacheStats.evictions
+                  << ", size " << cache.size() << " (entries " << cacheStats.entries << ") of "
+                  << cache.max_size() << std::endl;
+        assert(cache.size() <= cache.max_size() && cacheStats.entries <= cacheStats.max_entries);
+        assert(cacheStats.hits == hits.load() && cacheStats.misses == threads * opsPerThread - hits.load());
+    }
+    // More shards than entries: the shard count shrinks to fit cap.
+    MemoryMT<int, FastKeyHash> tiny(3, 64, MemoryGrowth::Evict);
+    for (int i = 0; i < 10000; ++i)
+        tiny.put("tiny" + std::to_string(i), i);
+    std::cout << "  cap 3 over 64 requested shards: " << tiny.shard_count() << " shards, size "
+              << tiny.size() << " of " << tiny.max_size() << std::endl;
+    assert(tiny.size() <= tiny.max_size() && tiny.stats().entries <= tiny.max_size());
+
+    // 8. Growth Under Load:
+    std::cout << "\n8. Growth Under Load (MemoryGrowth::Double from 1024 entries, 16 shards):" << std::endl;
+    {
+        const size_t writerCount = std::max<size_t>(2, threadCount / 2);
+        const size_t perWriter = 4000000 / writerCount;
+        BasicMemoryMT<uint64_t, uint64_t> growMem(1024, 16, MemoryGrowth::Double);
+        std::vector<std::atomic<size_t>> progress(writerCount); // keys put by each writer so far
+        std::atomic<size_t> writersLeft(writerCount), missing(0), wrong(0);
+        std::vector<std::vector<uint32_t>> putNs(writerCount), getNs(writerCount);
+        auto key_of = [writerCount](size_t writer, size_t i) { return uint64_t(i * writerCount + writer); };
+        auto elapsed_ns = [](std::chrono::steady_clock::time_point since) {
+            return static_cast<uint32_t>(std::min<int64_t>(UINT32_MAX,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count()));
+        };
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < writerCount; ++t) {
+            workers.emplace_back([&, t]() {
+                putNs[t].reserve(perWriter);
+                for (size_t i = 0; i < perWriter; ++i) {
+                    uint64_t key = key_of(t, i);
+                    auto op_start = std::chrono::steady_clock::now();
+                    growMem.put(key, key * 3 + 1);
+                    putNs[t].push_back(elapsed_ns(op_start));
+                    progress[t].store(i + 1, std::memory_order_release);
+                }
+                writersLeft.fetch_sub(1);
+            });
+            // Readers look up keys their writer has already put; every one must be there.
+            workers.emplace_back([&, t]() {
+                std::mt19937_64 local_gen(t + 1);
+                uint64_t value;
+                while (writersLeft.load() > 0) {
+                    size_t writer = local_gen() % writerCount;
+                    size_t done = progress[writer].load(std::memory_order_acquire);
+                    if (done == 0)
+                        continue;
+                    uint64_t key = key_of(writer, local_gen() % done);
+                    auto op_start = std::chrono::steady_clock::now();
+                    bool found = growMem.get(key, value);
+                    getNs[t].push_back(elapsed_ns(op_start));
+                    missing += !found;
+                    wrong += found && value != key * 3 + 1;
+                }
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+        auto report = [](const char* label, std::vector<std::vector<uint32_t>> &perThread) {
+            std::vector<uint32_t> all;
+            for (auto &v : perThread)
+                all.insert(all.end(), v.begin(), v.end());
+            if (all.empty())
+                return;
+            std::sort(all.begin(), all.end());
+            auto at = [&all](double q) { return all[static_cast<size_t>(q * static_cast<double>(all.size() - 1))]; };
+            std::cout << "  " << label << all.size() << " ops, p50 " << at(0.5) << " ns, p99 " << at(0.99)
+                      << " ns, p999 " << at(0.999) << " ns, max " << all.back() / 1000 << " us" << std::endl;
+        };
+        report("put: ", putNs);
+        report("get: ", getNs);
+        MemoryStats growStats = growMem.stats();
+        std::cout << "  entries " << growMem.size() << " of " << writerCount * perWriter << ", slots "
+                  << growStats.slots << ", reads missing " << missing.load() << ", wrong " << wrong.load()
+                  << std::endl;
+    }
+
+    // 9. Views Under Load:
+    std::cout << "\n9. Views Under Load (writers keep inserting while views are scanned):" << std::endl;
+    {
+        const size_t writerCount = std::max<size_t>(2, threadCount / 2);
+        const size_t perWriter = 2000000 / writerCount;
+        BasicMemoryMT<uint64_t, uint64_t> viewMem(1024, 16, MemoryGrowth::Double);
+        std::atomic<size_t> writersLeft(writerCount);
+        std::vector<std::thread> writers;
+        for (size_t t = 0; t < writerCount; ++t) {
+            writers.emplace_back([&, t]() {
+                for (size_t i = 0; i < perWriter; ++i) {
+                    uint64_t key = i * writerCount + t;
+                    viewMem.put(key, key * 3 + 1);
+                }
+                writersLeft.fetch_sub(1);
+            });
+        }
+        // Each writer puts its keys in order, so a view that is one moment of
+        // every shard holds a prefix of each writer's keys and nothing else.
+        size_t views = 0, inconsistent = 0, scanned = 0;
+        std::vector<double> takeMicros;
+        double scanSeconds = 0;
+        const size_t workers = ThreadPool::shared().size() + 1;
+        do {
+            auto take_start = std::chrono::steady_clock::now();
+            auto view = viewMem.view();
+            auto scan_start = std::chrono::steady_clock::now();
+            std::vector<std::vector<size_t>> count(workers, std::vector<size_t>(writerCount));
+            std::vector<std::vector<size_t>> top(workers, std::vector<size_t>(writerCount));
+            std::vector<size_t> wrong(workers);
+            view.parallel_for_each([&](size_t worker, uint64_t key, const uint64_t &value) {
+                size_t writer = key % writerCount, i = key / writerCount;
+                ++count[worker][writer];
+                top[worker][writer] = std::max(top[worker][writer], i + 1);
+                wrong[worker] += value != key * 3 + 1;
+            });
+            auto scan_end = std::chrono::steady_clock::now();
+            size_t total = 0;
+            for (size_t w = 0; w < workers; ++w)
+                inconsistent += wrong[w];
+            for (size_t writer = 0; writer < writerCount; ++writer) {
+                size_t n = 0, highest = 0;
+                for (size_t w = 0; w < workers; ++w) {
+                    n += count[w][writer];
+                    highest = std::max(highest, top[w][writer]);
+                }
+                inconsistent += n != highest;
+                total += n;
+            }
+            inconsistent += total != view.size();
+            ++views;
+            scanned += total;
+            takeMicros.push_back(std::chrono::duration<double, std::micro>(scan_start - take_start).count());
+            scanSeconds += std::chrono::duration<double>(scan_end - scan_start).count();
+        } while (writersLeft.load() > 0);
+        for (auto &w : writers)
+            w.join();
+        std::sort(takeMicros.begin(), takeMicros.end());
+        std::cout << "  " << views << " views, " << inconsistent << " inconsistent; median take "
+                  << static_cast<long>(takeMicros[takeMicros.size() / 2]) << " us, scans " << scanned / scanSeconds / 1e6
+                  << " M entries/sec" << std::endl;
+        std::cout << "  entries " << viewMem.size() << " of " << writerCount * perWriter << ", final view "
+                  << viewMem.view().size() << std::endl;
+    }
+
     return 0;
 }
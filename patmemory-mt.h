@@ -3,64 +3,457 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <memory>
+#include <atomic>
+#include <type_traits>
+#include <algorithm>
+#include <span>
+#include <chrono>
+#include <mutex>
 #include "pattern.h"
+#include "patmemory.h"
+#include "pattern-threadpool.h"
 #include <shared_mutex>
 
-template<typename Value>
-class MemoryMT {
+// Lock-striped table: `shards` independent BasicMemory sub-tables, each with
+// its own reader/writer lock on a separate cache line. A key's shard comes from
+// the top bits of a multiply of its hash (the raw pattern hash has almost no
+// high bits set), so threads touching different shards never share
+// a lock. Each shard counts its own entries and size() sums them. With
+// MemoryGrowth::Fixed the entry limit is fixed at construction and admitted
+// through one global count, so it holds exactly whatever the shard count;
+// shards start at cap / shards and grow incrementally under their own lock if
+// the keys are skewed. With MemoryGrowth::Double there is no limit and cap is
+// only the initial size.
+//
+// A shard grows without stopping its readers for a full rehash. The old and
+// new arrays coexist, lookups check both, and every put into the shard
+// moves a few groups across. A put also moves a few groups of the next shard
+// if that one is migrating and its lock is free, so a shard that stops
+// receiving puts still finishes while the rest of the table is written.
+// The new array itself is ordered from ThreadPool::shared() once a shard is
+// within a quarter of its threshold, so the allocation and its page faults
+// happen off the lock, and the put that crosses the threshold only swaps it
+// in. If the spare has not arrived by then, that put allocates it in place.
+//
+// Reads of trivially copyable values take no lock: each shard carries a
+// seqlock version that writers make odd for the duration of a put, and get()
+// retries if the version moved while it probed. A lookup therefore writes no
+// shared memory at all. After kOptimisticRetries failed attempts, and for any
+// other Value type, get() falls back to the shared lock.
+//
+// Constructed with MemoryGrowth::Evict, the table is a cache: each shard is
+// a Memory in Evict mode holding cap / shards entries (the first cap % shards
+// hold one more, so the table never exceeds cap), and a put into a full
+// shard evicts a cold entry of that shard (CLOCK) under the shard's own lock.
+// Reads then always take the shared lock. Eviction recycles slots and key
+// bytes, which a lock-free reader could be halfway through.
+//
+// for_each() visits one shard at a time under its shared lock, so it is not
+// one moment of the table. view() is: it locks every shard only while it
+// registers, and the scan then runs without locks.
+//
+// MemoryMT<Value> has std::string keys; BasicMemoryMT<Key, Value> takes the
+// inline key types of BasicMemory too. Alloc is every shard's slot storage
+// (e.g. HugePageAllocator<uint8_t>, see patmemory-alloc.h).
+template<typename Key, typename Value, typename Hasher = MemoryDefaultHash<Key>,
+         typename Alloc = std::allocator<uint8_t>>
+class BasicMemoryMT {
+public:
+    using KeyRef = typename BasicMemory<Key, Value, Hasher, Alloc>::KeyRef;
+
 private:
-    struct Entry {
-        std::string key;
-        Value value;
-        bool used;
-        Entry() : key(""), value(), used(false) {}
+    // Not Memory's Fibonacci constant: both pick the top bits of a product,
+    // so with the same multiplier a shard's keys would share the top bits of
+    // their home group and crowd into 1/shards of its groups.
+    static constexpr uint64_t kShardMix = 0xD6E8FEB86659FD93ULL;
+    static constexpr bool kOptimistic = std::is_trivially_copyable_v<Value>;
+    static constexpr int kOptimisticRetries = 8;
+    static constexpr size_t kBatch = 16;    // keys in flight per get_many/put_many step
+
+    using Table = BasicMemory<Key, Value, Hasher, Alloc>;
+
+    // A spare array being allocated on the pool. Shared with the pool task,
+    // which never touches the shard, so a table may die with one in flight.
+    struct SpareOrder {
+        std::mutex mutex;
+        typename Table::Spare spare;
+        bool ready = false;
+    };
+
+    struct Shard {
+        alignas(64) mutable std::shared_mutex mutex; // writers; readers once optimism fails
+        std::atomic<uint64_t> version;               // odd while a put is in progress
+        std::atomic<size_t> entries;                 // table.size(), readable without the lock
+        std::shared_ptr<SpareOrder> spare_order;     // in flight; guarded by mutex
+        alignas(64) Table table;
+        Shard(size_t cap, bool evict, const Hasher &hasher)
+            : version(0), entries(0), table(cap, evict ? MemoryGrowth::Evict : MemoryGrowth::Double, hasher) {
+            if (kOptimistic && !evict)
+                table.enable_optimistic_reads();
+        }
     };
 
-    std::vector<Entry> table;  // declared first...
-    size_t capacity;           // ...then capacity
-    mutable std::shared_mutex mutex; // for multithreaded access
+    // Holds a shard's version odd for its lifetime; the caller owns the mutex.
+    struct WriteSection {
+        std::atomic<uint64_t> &version;
+        uint64_t start;
+        explicit WriteSection(std::atomic<uint64_t> &v) : version(v), start(v.load(std::memory_order_relaxed)) {
+            version.store(start + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        ~WriteSection() { version.store(start + 2, std::memory_order_release); }
+    };
 
-public:
-    // Constructor: note the initializer order now matches the declaration order.
-    MemoryMT(size_t cap) : table(cap), capacity(cap) {}
-
-    // Insert (returns true on success, false if full)
-    bool put(const std::string &key, const Value &value) {
-        std::unique_lock lock(mutex); // acquire exclusive lock for writing
-        uint64_t hash = hash_function_64(key.c_str(), key.size());
-        size_t index = hash % capacity;
-        size_t start = index;
-        // Use linear probing to resolve collisions.
-        do {
-            if (!table[index].used || table[index].key == key) {
-                table[index].key = key;
-                table[index].value = value;
-                table[index].used = true;
-                return true;
+    std::vector<std::unique_ptr<Shard>> shards;
+    unsigned shard_shift;   // 64 - log2(shard count)
+    size_t capacity;
+    bool evict;             // MemoryGrowth::Evict: shards evict instead of refusing
+    bool limited;           // MemoryGrowth::Fixed: new keys are admitted against capacity
+    [[no_unique_address]] Hasher hasher;
+    [[no_unique_address]] MemoryCounters counters; // lock waits and optimistic retries
+    alignas(64) std::atomic<size_t> admitted; // Fixed only: touched when a new key is inserted
+
+    size_t shard_index(uint64_t hash) const {
+        return shards.size() == 1 ? 0 : static_cast<size_t>((hash * kShardMix) >> shard_shift);
+    }
+
+    Shard &shard_for(uint64_t hash) const { return *shards[shard_index(hash)]; }
+
+    // Takes a deferred lock; stats builds time the wait when it cannot be had
+    // at once, so an uncontended acquire costs one try_lock either way.
+    template<typename Lock>
+    void acquire(Lock &lock) const {
+        if constexpr (kMemoryStats) {
+            if (lock.try_lock())
+                return;
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            counters.lock_wait(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count()));
+        } else {
+            lock.lock();
+        }
+    }
+
+    // Reserves one of the `capacity` entries for a new key. Only Fixed tables
+    // share a count: Double has no limit and evicting shards enforce their own.
+    bool admit() {
+        if (!limited)
+            return true;
+        if (admitted.fetch_add(1, std::memory_order_relaxed) < capacity)
+            return true;
+        admitted.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // After a write, under the shard's exclusive lock: publishes the shard's
+    // entry count for size(). A plain store, skipped when nothing was added.
+    static void settle(Shard &shard) {
+        size_t now = shard.table.size();
+        if (now != shard.entries.load(std::memory_order_relaxed))
+            shard.entries.store(now, std::memory_order_relaxed);
+    }
+
+    // After a write, under the exclusive lock of shard `index`: hands an
+    // arrived spare array to the table, or orders one if the table is nearing
+    // a rehash, and helps the next shard along if it is migrating.
+    void tend_spare(size_t index) const {
+        Shard &shard = *shards[index];
+        if (shards.size() > 1)
+            help_migrate(*shards[(index + 1) & (shards.size() - 1)]);
+        if (std::shared_ptr<SpareOrder> order = shard.spare_order) {
+            typename Table::Spare arrived;
+            {
+                std::lock_guard lock(order->mutex);
+                if (!order->ready)
+                    return;
+                arrived = std::move(order->spare);
             }
-            index = (index + 1) % capacity;
-        } while (index != start);
-        return false; // Table is full.
+            shard.spare_order.reset();
+            shard.table.give_spare(std::move(arrived));
+        }
+        size_t groups = shard.table.spare_wanted();
+        if (groups == 0)
+            return;
+        auto order = std::make_shared<SpareOrder>();
+        shard.spare_order = order;
+        ThreadPool::shared().submit([order, groups, clock = evict] {
+            typename Table::Spare made = Table::make_spare(groups, clock);
+            std::lock_guard lock(order->mutex);
+            order->spare = std::move(made);
+            order->ready = true;
+        });
+    }
+
+    // Moves a few groups of a migrating shard if its lock is free. Only
+    // writers call it, holding another shard's lock, hence try_lock.
+    void help_migrate(Shard &shard) const {
+        if (!shard.table.migrating())
+            return;
+        std::unique_lock lock(shard.mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;
+        WriteSection section(shard.version);
+        shard.table.migrate_step();
+    }
+
+public:
+    // shard_count is rounded up to a power of two. growth is Fixed (put()
+    // fails at cap; the default), Double (no limit; cap is the initial size)
+    // or Evict (a cache of at most cap entries; the shard count is then
+    // halved until every shard holds at least one).
+    BasicMemoryMT(size_t cap, size_t shard_count = 1, Hasher hasher = Hasher())
+        : BasicMemoryMT(cap, shard_count, MemoryGrowth::Fixed, std::move(hasher)) {}
+
+    BasicMemoryMT(size_t cap, size_t shard_count, MemoryGrowth growth, Hasher hasher = Hasher())
+        : shard_shift(64), capacity(growth == MemoryGrowth::Double ? SIZE_MAX : cap),
+          evict(growth == MemoryGrowth::Evict), limited(growth == MemoryGrowth::Fixed),
+          hasher(std::move(hasher)), admitted(0) {
+        size_t n = 1;
+        while (n < shard_count && (!evict || n * 2 <= cap)) {
+            n <<= 1;
+            --shard_shift;
+        }
+        // Evicting shards each enforce their share, so the shares add up to cap exactly.
+        shards.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+            shards.push_back(std::make_unique<Shard>(cap / n + (i < cap % n), evict, this->hasher));
+    }
+
+    // Insert (returns true on success, false once max_size() entries exist)
+    bool put(KeyRef key, const Value &value) {
+        return put_hashed(key, hasher(key), value);
+    }
+
+    bool put(KeyRef key, Value &&value) {
+        return put_hashed(key, hasher(key), std::move(value));
+    }
+
+    // Constructs Value(args...) only if key is absent; returns true if it did.
+    // Entries are not handed out by pointer: they would outlive the shard lock.
+    template<typename... Args>
+    bool try_emplace(KeyRef key, Args &&...args) {
+        uint64_t hash = hasher(key);
+        size_t index = shard_index(hash);
+        Shard &shard = *shards[index];
+        std::unique_lock lock(shard.mutex, std::defer_lock);
+        acquire(lock);
+        WriteSection section(shard.version);
+        bool inserted = shard.table.emplace_hashed(key, hash, [this] { return admit(); },
+                                                   [&] { return Value(std::forward<Args>(args)...); }).second;
+        settle(shard);
+        tend_spare(index);
+        return inserted;
     }
 
     // Retrieve value; returns true if found.
-    bool get(const std::string &key, Value &value_out) const {
-        std::shared_lock lock(mutex); // acquire shared lock for reading
-        uint64_t hash = hash_function_64(key.c_str(), key.size());
-        size_t index = hash % capacity;
-        size_t start = index;
-        while (table[index].used) {
-            if (table[index].key == key) {
-                value_out = table[index].value;
-                return true;
+    bool get(KeyRef key, Value &value_out) const {
+        return get_hashed(key, hasher(key), value_out);
+    }
+
+    // Lookup under the shard's shared lock; get() without the optimistic path.
+    bool get_locked(KeyRef key, Value &value_out) const {
+        return get_locked(key, hasher(key), value_out);
+    }
+
+    // Batched get(): a batch of keys is hashed and its home groups and slots
+    // prefetched before any key is probed, so the misses overlap. Prefetching
+    // needs the lock-free layout; other value types and caches just probe in order.
+    // values_out (and found, unless empty) must hold keys.size() elements.
+    size_t get_many(std::span<const std::string> keys, std::span<Value> values_out,
+                    std::span<bool> found = {}) const requires std::is_same_v<Key, std::string> {
+        return get_many_impl(keys, values_out, found);
+    }
+
+    size_t get_many(std::span<const KeyRef> keys, std::span<Value> values_out,
+                    std::span<bool> found = {}) const {
+        return get_many_impl(keys, values_out, found);
+    }
+
+    // Batched put(): each batch is grouped by shard, so a shard's lock and
+    // version bump are taken once per batch instead of once per key. Order is
+    // kept within a shard, so a repeated key keeps its last value. Returns the
+    // number of keys stored; stored (unless empty) gets the result per key.
+    size_t put_many(std::span<const std::string> keys, std::span<const Value> values,
+                    std::span<bool> stored = {}) requires std::is_same_v<Key, std::string> {
+        return put_many_impl(keys, values, stored);
+    }
+
+    size_t put_many(std::span<const KeyRef> keys, std::span<const Value> values,
+                    std::span<bool> stored = {}) {
+        return put_many_impl(keys, values, stored);
+    }
+
+    // Calls fn(key, value) for every entry, one shard at a time under its
+    // shared lock; entries put concurrently may or may not be visited.
+    template<typename Fn>
+    void for_each(Fn &&fn) const {
+        for (const auto &shard : shards) {
+            std::shared_lock lock(shard->mutex);
+            shard->table.for_each(fn);
+        }
+    }
+
+    // Point-in-time view of the whole table (see BasicMemoryView): every
+    // shard is locked at once, just long enough to register the view, so it
+    // is one moment across shards. Scanning it takes no shard lock; writes
+    // copy a group into it the first time they touch that group.
+    BasicMemoryView<Key, Value, Hasher, Alloc> view() const {
+        BasicMemoryView<Key, Value, Hasher, Alloc> v;
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        locks.reserve(shards.size());
+        for (const auto &shard : shards) {
+            locks.emplace_back(shard->mutex, std::defer_lock);
+            acquire(locks.back());
+        }
+        for (const auto &shard : shards)
+            shard->table.add_to_view(v);
+        return v;
+    }
+
+    // Sum of the shards' counts; entries put meanwhile may or may not be in it.
+    size_t size() const {
+        size_t n = 0;
+        for (const auto &shard : shards)
+            n += shard->entries.load(std::memory_order_relaxed);
+        return n;
+    }
+    size_t max_size() const { return capacity; }
+    bool evicting() const { return evict; }
+
+    size_t shard_count() const { return shards.size(); }
+
+    // Shard stats summed (load_factor is the fullest shard's), plus lock
+    // waits and optimistic retries. Each shard is read under its shared lock.
+    MemoryStats stats() const {
+        MemoryStats s;
+        s.max_entries = capacity;
+        for (const auto &shard : shards) {
+            std::shared_lock lock(shard->mutex);
+            MemoryStats part = shard->table.stats();
+            part.bytes_total += sizeof(Shard) - sizeof(shard->table);
+            s.merge(part);
+        }
+        s.bytes_total += sizeof(*this) + shards.capacity() * sizeof(shards[0]);
+        counters.add_to(s);
+        return s;
+    }
+
+private:
+    template<typename K>
+    size_t get_many_impl(std::span<const K> keys, std::span<Value> values_out, std::span<bool> found) const {
+        uint64_t hashes[kBatch];
+        size_t hits = 0;
+        for (size_t base = 0; base < keys.size(); base += kBatch) {
+            size_t n = std::min(kBatch, keys.size() - base);
+            hash_keys(hasher, keys.subspan(base, n), hashes);
+            if (kOptimistic && !evict) { // evicting shards may free arrays under an unlocked prefetch
+                for (size_t i = 0; i < n; ++i)
+                    shard_for(hashes[i]).table.prefetch_group(hashes[i]);
+                for (size_t i = 0; i < n; ++i)
+                    shard_for(hashes[i]).table.prefetch_slot(hashes[i]);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                bool hit = get_hashed(keys[base + i], hashes[i], values_out[base + i]);
+                if (!found.empty())
+                    found[base + i] = hit;
+                hits += hit;
             }
-            index = (index + 1) % capacity;
-            if (index == start)
-                break;
         }
-        return false;
+        return hits;
+    }
+
+    template<typename K>
+    size_t put_many_impl(std::span<const K> keys, std::span<const Value> values, std::span<bool> stored) {
+        uint64_t hashes[kBatch];
+        size_t shard_of[kBatch];
+        size_t order[kBatch];
+        size_t done = 0;
+        for (size_t base = 0; base < keys.size(); base += kBatch) {
+            size_t n = std::min(kBatch, keys.size() - base);
+            hash_keys(hasher, keys.subspan(base, n), hashes);
+            for (size_t i = 0; i < n; ++i) {
+                shard_of[i] = shard_index(hashes[i]);
+                order[i] = i;
+            }
+            std::stable_sort(order, order + n, [&](size_t a, size_t b) { return shard_of[a] < shard_of[b]; });
+            for (size_t j = 0; j < n;) {
+                size_t run_end = j;
+                while (run_end < n && shard_of[order[run_end]] == shard_of[order[j]])
+                    ++run_end;
+                size_t index = shard_of[order[j]];
+                Shard &shard = *shards[index];
+                std::unique_lock lock(shard.mutex, std::defer_lock);
+                acquire(lock);
+                WriteSection section(shard.version);
+                for (size_t k = j; k < run_end; ++k)
+                    shard.table.prefetch_group(hashes[order[k]]);
+                for (; j < run_end; ++j) {
+                    size_t i = order[j];
+                    bool ok = shard.table.put_hashed(keys[base + i], hashes[i], values[base + i],
+                                                     [this] { return admit(); });
+                    if (!stored.empty())
+                        stored[base + i] = ok;
+                    done += ok;
+                }
+                settle(shard);
+                tend_spare(index);
+            }
+        }
+        return done;
+    }
+
+    template<typename V>
+    bool put_hashed(KeyRef key, uint64_t hash, V &&value) {
+        size_t index = shard_index(hash);
+        Shard &shard = *shards[index];
+        std::unique_lock lock(shard.mutex, std::defer_lock); // exclusive lock on this shard only
+        acquire(lock);
+        WriteSection section(shard.version);
+        bool ok = shard.table.put_hashed(key, hash, std::forward<V>(value), [this] { return admit(); });
+        settle(shard);
+        tend_spare(index);
+        return ok;
+    }
+
+    bool get_hashed(KeyRef key, uint64_t hash, Value &value_out) const {
+        Shard &shard = shard_for(hash);
+        if constexpr (kOptimistic) {
+            for (int attempt = 0; attempt < kOptimisticRetries && !evict; ++attempt) {
+                uint64_t before = shard.version.load(std::memory_order_acquire);
+                if (before & 1) {
+                    counters.optimistic_retry();
+#ifdef PATTERN_X86_64
+                    _mm_pause(); // a put is in progress
+#endif
+                    continue;
+                }
+                Value candidate;
+                bool found = shard.table.get_optimistic(key, hash, candidate);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (shard.version.load(std::memory_order_relaxed) == before) {
+                    if (found)
+                        value_out = candidate;
+                    return found;
+                }
+                counters.optimistic_retry();
+            }
+        }
+        return get_locked(key, hash, value_out);
+    }
+
+    bool get_locked(KeyRef key, uint64_t hash, Value &value_out) const {
+        Shard &shard = shard_for(hash);
+        std::shared_lock lock(shard.mutex, std::defer_lock); // shared lock on this shard only
+        acquire(lock);
+        return shard.table.get_hashed(key, hash, value_out);
     }
 };
 
+template<typename Value, typename Hasher = PatternKeyHash, typename Alloc = std::allocator<uint8_t>>
+using MemoryMT = BasicMemoryMT<std::string, Value, Hasher, Alloc>;
+
 #endif // PATMEMORY_MT_H
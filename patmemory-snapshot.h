@@ -0,0 +1,489 @@
+#ifndef PATMEMORY_SNAPSHOT_H
+#define PATMEMORY_SNAPSHOT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pattern.h"
+#include "pattern-parallel.h"
+#include "pattern-stream.h"
+#include "patmemory.h"
+
+// On-disk snapshot of a Memory or MemoryMT, served straight from mmap.
+//
+// File layout (native byte order, sections 64-byte aligned):
+//   Header   magic, version, sizeof/alignof(Value), hasher check, counts, checksums
+//   ctrl     groups * 16 control bytes, tagged exactly like Memory's
+//   entries  groups * 16 Entry {hash, key offset, key length, value}
+//   keys     key bytes, addressed by offset from the start of this section
+// Nothing in the file is a pointer, so it maps at any address and is probed
+// like a Memory table (groups of 16, Fibonacci home group, 7-bit tags); open
+// costs one mmap plus, if asked, one checksum pass. Values are stored
+// bytewise, so Value must be trivially copyable. Slots are placed by
+// Hasher, so a file only opens with the hasher it was saved with; the header
+// records that hasher's hash of a fixed string to catch a mismatch.
+//
+// The header checksums everything after it twice: with the pattern hash,
+// which only sees '*', '&' and the length, and with a Fletcher-64 sum that
+// catches changes to any other byte.
+
+constexpr uint32_t kSnapshotVersion = 2;
+
+template<typename Value, typename Hasher>
+class MemorySnapshot {
+private:
+    static_assert(std::is_trivially_copyable_v<Value>, "snapshots store values bytewise");
+
+    using Table = Memory<Value, Hasher>;
+    static constexpr size_t kGroup = Table::kGroup;
+    static constexpr size_t kAlign = 64;
+    static constexpr std::string_view kHasherProbe = "*&pattern snapshot&*";
+    static constexpr double kLoad = 0.875;
+    static constexpr char kMagic[8] = {'P', 'A', 'T', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr uint32_t kByteOrder = 0x01020304;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;    // kByteOrder as written by the saving machine
+        uint32_t value_size;
+        uint32_t value_align;
+        uint64_t entries;
+        uint64_t groups;        // power of two
+        uint64_t key_bytes;
+        uint64_t body_hash;     // hash_function_64 of everything after the header
+        uint64_t body_sum;      // fletcher64 of the same bytes
+        uint64_t hasher_check;  // Hasher()(kHasherProbe)
+        uint64_t reserved[7];
+    };
+    static_assert(sizeof(Header) == 2 * kAlign);
+
+    struct Entry {
+        uint64_t hash;
+        uint64_t key_offset;
+        uint64_t key_len;
+        Value value;
+    };
+    static_assert(alignof(Entry) <= kAlign, "the entries section is kAlign-aligned");
+
+    // Byte offsets of each section, from the start of the file.
+    struct Layout {
+        size_t ctrl, entries, keys, total;
+
+        Layout(size_t groups, size_t key_bytes) {
+            ctrl = sizeof(Header);
+            entries = align(ctrl + groups * kGroup);
+            keys = entries + groups * kGroup * sizeof(Entry);
+            total = keys + key_bytes;
+        }
+    };
+
+    unsigned char* map = nullptr;
+    size_t map_len = 0;
+    const uint8_t* ctrl = nullptr;
+    const Entry* entries = nullptr;
+    const char* keys = nullptr;
+    size_t key_bytes = 0;
+    size_t count = 0;
+    size_t group_mask = 0;
+    unsigned group_shift = 64;
+    std::string failure;
+    [[no_unique_address]] Hasher hasher;
+
+    static size_t align(size_t n) { return (n + kAlign - 1) & ~(kAlign - 1); }
+
+    static size_t home_group(uint64_t hash, size_t mask, unsigned shift) {
+        return mask == 0 ? 0 : static_cast<size_t>((hash * Table::kFibonacci) >> shift);
+    }
+
+    // Fletcher-64 over little 32-bit words; the tail is zero-padded. Fed in
+    // pieces of any length, it sums the same words as one pass would.
+    class Fletcher64 {
+    private:
+        static constexpr uint64_t kMod = 0xFFFFFFFF;
+        uint64_t a = 0, b = 0;
+        size_t pending_words = 0;   // added since the last reduction
+        unsigned char partial[4] = {};
+        size_t partial_len = 0;     // bytes of a word split across pieces
+
+        void add(uint32_t w) {
+            a += w;
+            b += a;
+            // 4096 words keep a below 2^45 and b below 2^57 between reductions
+            if (++pending_words == 4096) {
+                a %= kMod;
+                b %= kMod;
+                pending_words = 0;
+            }
+        }
+
+    public:
+        void update(const unsigned char* data, size_t len) {
+            while (partial_len > 0 && partial_len < 4 && len > 0) {
+                partial[partial_len++] = *data++;
+                --len;
+            }
+            if (partial_len == 4) {
+                uint32_t w;
+                std::memcpy(&w, partial, 4);
+                add(w);
+                partial_len = 0;
+            }
+            for (; len >= 4; data += 4, len -= 4) {
+                uint32_t w;
+                std::memcpy(&w, data, 4);
+                add(w);
+            }
+            std::memcpy(partial + partial_len, data, len);
+            partial_len += len;
+        }
+
+        uint64_t finish() const {
+            uint64_t fa = a % kMod, fb = b % kMod;
+            if (partial_len) {
+                uint32_t w = 0;
+                std::memcpy(&w, partial, partial_len);
+                fa = (fa + w) % kMod;
+                fb = (fb + fa) % kMod;
+            }
+            return (fb << 32) | fa;
+        }
+    };
+
+    static uint64_t fletcher64(const unsigned char* data, size_t len) {
+        Fletcher64 sum;
+        sum.update(data, len);
+        return sum.finish();
+    }
+
+    static bool write_at(int fd, const void* data, size_t len, off_t offset) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        while (len > 0) {
+            ssize_t n = ::pwrite(fd, p, len, offset);
+            if (n <= 0)
+                return false;
+            p += n;
+            len -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+
+    // Writes a snapshot's body after the header's place in kWriteChunk-byte
+    // pieces, checksumming each piece as it goes out; the header is written
+    // last, once the checksums are known.
+    class BodyWriter {
+    private:
+        static constexpr size_t kWriteChunk = size_t(1) << 20;
+        int fd;
+        off_t offset = sizeof(Header);
+        std::vector<unsigned char> buffer;
+        PatternHasher hash;
+        Fletcher64 sum;
+        bool ok = true;
+
+        void flush() {
+            hash.update(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            sum.update(buffer.data(), buffer.size());
+            ok = ok && write_at(fd, buffer.data(), buffer.size(), offset);
+            offset += static_cast<off_t>(buffer.size());
+            buffer.clear();
+        }
+
+    public:
+        explicit BodyWriter(int fd) : fd(fd) { buffer.reserve(kWriteChunk); }
+
+        void append(const void* data, size_t len) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            while (len > 0) {
+                size_t n = std::min(len, kWriteChunk - buffer.size());
+                buffer.insert(buffer.end(), p, p + n);
+                p += n;
+                len -= n;
+                if (buffer.size() == kWriteChunk)
+                    flush();
+            }
+        }
+
+        // Section padding: fewer than kAlign bytes.
+        void zeros(size_t len) {
+            static constexpr unsigned char zero[kAlign] = {};
+            append(zero, len);
+        }
+
+        bool finish(uint64_t &body_hash, uint64_t &body_sum) {
+            if (!buffer.empty())
+                flush();
+            body_hash = hash.finalize();
+            body_sum = sum.finish();
+            return ok;
+        }
+    };
+
+    bool fail(std::string message) {
+        failure = std::move(message);
+        return false;
+    }
+
+    void unmap() {
+        if (map)
+            munmap(map, map_len);
+        map = nullptr;
+        map_len = 0;
+    }
+
+    size_t find(std::string_view key, uint64_t hash) const {
+        uint8_t tag = Table::tag_of(hash);
+        size_t group = home_group(hash, group_mask, group_shift);
+        for (size_t probed = 0; probed <= group_mask; ++probed) {
+            const uint8_t* g = ctrl + group * kGroup;
+            for (uint32_t match = Table::group_match(g, tag); match != 0; match &= match - 1) {
+                size_t index = group * kGroup + static_cast<size_t>(__builtin_ctz(match));
+                const Entry &e = entries[index];
+                if (e.hash == hash && e.key_len == key.size() && e.key_offset <= key_bytes &&
+                    e.key_len <= key_bytes - e.key_offset &&
+                    (key.empty() || std::memcmp(keys + e.key_offset, key.data(), key.size()) == 0))
+                    return index;
+            }
+            if (Table::group_match(g, Table::kEmpty) != 0)
+                break;
+            group = (group + 1) & group_mask;
+        }
+        return SIZE_MAX;
+    }
+
+    bool open(const std::string &path, bool verify) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return fail("cannot open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            return fail("not a snapshot: " + path);
+        }
+        map_len = static_cast<size_t>(st.st_size);
+        void* p = mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            map_len = 0;
+            return fail("mmap failed: " + path);
+        }
+        map = static_cast<unsigned char*>(p);
+
+        Header h;
+        std::memcpy(&h, map, sizeof(h));
+        if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0)
+            return fail("not a snapshot: " + path);
+        if (h.version != kSnapshotVersion)
+            return fail("unsupported snapshot version " + std::to_string(h.version));
+        if (h.byte_order != kByteOrder)
+            return fail("snapshot written with another byte order");
+        if (h.value_size != sizeof(Value) || h.value_align != alignof(Value))
+            return fail("snapshot value type does not match");
+        if (h.hasher_check != hasher(kHasherProbe))
+            return fail("snapshot was saved with another hasher");
+        if (h.groups == 0 || (h.groups & (h.groups - 1)) != 0 || h.groups > map_len / kGroup ||
+            h.entries > h.groups * kGroup || h.key_bytes > map_len)
+            return fail("corrupt snapshot header");
+        Layout layout(h.groups, h.key_bytes);
+        if (layout.total != map_len)
+            return fail("snapshot size does not match its header");
+        if (verify) {
+            const unsigned char* body = map + sizeof(Header);
+            size_t body_len = map_len - sizeof(Header);
+            if (hash_function_64_parallel(reinterpret_cast<const char*>(body), body_len) != h.body_hash ||
+                fletcher64(body, body_len) != h.body_sum)
+                return fail("snapshot checksum mismatch");
+        }
+
+        ctrl = map + layout.ctrl;
+        entries = reinterpret_cast<const Entry*>(map + layout.entries);
+        keys = reinterpret_cast<const char*>(map + layout.keys);
+        key_bytes = h.key_bytes;
+        count = h.entries;
+        group_mask = h.groups - 1;
+        for (size_t g = h.groups; g > 1; g >>= 1)
+            --group_shift;
+        return true;
+    }
+
+public:
+    MemorySnapshot() = default;
+    MemorySnapshot(const MemorySnapshot &) = delete;
+    MemorySnapshot &operator=(const MemorySnapshot &) = delete;
+
+    MemorySnapshot(MemorySnapshot &&other) noexcept { *this = std::move(other); }
+
+    MemorySnapshot &operator=(MemorySnapshot &&other) noexcept {
+        if (this != &other) {
+            unmap();
+            map = std::exchange(other.map, nullptr);
+            map_len = std::exchange(other.map_len, 0);
+            ctrl = other.ctrl;
+            entries = other.entries;
+            keys = other.keys;
+            key_bytes = other.key_bytes;
+            count = std::exchange(other.count, 0);
+            group_mask = other.group_mask;
+            group_shift = other.group_shift;
+            failure = std::move(other.failure);
+        }
+        return *this;
+    }
+
+    ~MemorySnapshot() { unmap(); }
+
+    // Writes every entry of `source` (a Memory, a MemoryMT, or a view of
+    // either, which exports one moment without holding locks) to path. The
+    // file is written beside it and renamed into place, so readers never see
+    // half a snapshot. Entries go out in 1 MB pieces as they are laid out, so
+    // beside its copy of the entries and keys, save() holds only a control
+    // byte and an entry index per slot. Returns false on any I/O error.
+    template<typename Source>
+    static bool save(const Source &source, const std::string &path) {
+        Hasher hasher;
+        std::vector<Entry> flat;
+        std::string key_data;
+        source.for_each([&](std::string_view key, const Value &value) {
+            Entry e{};
+            e.hash = hasher(key);
+            e.key_offset = key_data.size();
+            e.key_len = key.size();
+            e.value = value;
+            flat.push_back(e);
+            key_data.append(key);
+        });
+
+        size_t groups = 1;
+        while (static_cast<double>(groups * kGroup) * kLoad < static_cast<double>(flat.size()))
+            groups <<= 1;
+        size_t mask = groups - 1;
+        unsigned shift = 64;
+        for (size_t g = groups; g > 1; g >>= 1)
+            --shift;
+
+        // Only the control bytes and each slot's entry index are built up
+        // front; the entries themselves are written slot by slot.
+        std::vector<uint8_t> body_ctrl(groups * kGroup, Table::kEmpty);
+        std::vector<size_t> slot_entry(groups * kGroup, SIZE_MAX);
+        for (size_t i = 0; i < flat.size(); ++i) {
+            size_t group = home_group(flat[i].hash, mask, shift);
+            uint32_t free;
+            while ((free = Table::group_free(body_ctrl.data() + group * kGroup)) == 0)
+                group = (group + 1) & mask;
+            size_t index = group * kGroup + static_cast<size_t>(__builtin_ctz(free));
+            body_ctrl[index] = Table::tag_of(flat[i].hash);
+            slot_entry[index] = i;
+        }
+
+        std::string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        Layout layout(groups, key_data.size());
+        BodyWriter body(fd);
+        body.append(body_ctrl.data(), body_ctrl.size());
+        body.zeros(layout.entries - layout.ctrl - body_ctrl.size());
+        for (size_t index : slot_entry) {
+            // Value-initialised first so padding bytes are zero in the file.
+            Entry slot{};
+            if (index != SIZE_MAX) {
+                const Entry &e = flat[index];
+                slot.hash = e.hash;
+                slot.key_offset = e.key_offset;
+                slot.key_len = e.key_len;
+                slot.value = e.value;
+            }
+            body.append(&slot, sizeof(slot));
+        }
+        body.append(key_data.data(), key_data.size());
+
+        Header h{};
+        std::memcpy(h.magic, kMagic, sizeof(kMagic));
+        h.version = kSnapshotVersion;
+        h.byte_order = kByteOrder;
+        h.value_size = sizeof(Value);
+        h.value_align = alignof(Value);
+        h.entries = flat.size();
+        h.groups = groups;
+        h.key_bytes = key_data.size();
+        h.hasher_check = hasher(kHasherProbe);
+        bool ok = body.finish(h.body_hash, h.body_sum) && write_at(fd, &h, sizeof(h), 0) && fsync(fd) == 0;
+        ok = ::close(fd) == 0 && ok;
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Maps a snapshot read-only. On failure the result is empty and error()
+    // says why. verify = false skips the checksum pass (one read of the whole
+    // file) and trusts the bytes; headers and key bounds are still checked.
+    static MemorySnapshot open_mapped(const std::string &path, bool verify = true) {
+        MemorySnapshot snapshot;
+        if (!snapshot.open(path, verify)) {
+            snapshot.unmap();
+            snapshot.count = 0;
+        }
+        return snapshot;
+    }
+
+    explicit operator bool() const { return map != nullptr; }
+    const std::string &error() const { return failure; }
+
+    // Retrieve value; returns true if found.
+    bool get(std::string_view key, Value &value_out) const {
+        const Value* value = find(key);
+        if (!value)
+            return false;
+        value_out = *value;
+        return true;
+    }
+
+    // Pointer into the mapping, or nullptr; valid while the snapshot is open.
+    const Value* find(std::string_view key) const {
+        if (!map)
+            return nullptr;
+        size_t index = find(key, hasher(key));
+        return index == SIZE_MAX ? nullptr : &entries[index].value;
+    }
+
+    // Calls fn(key, value) for every entry.
+    template<typename Fn>
+    void for_each(Fn &&fn) const {
+        if (!map)
+            return;
+        for (size_t i = 0; i < (group_mask + 1) * kGroup; ++i) {
+            if (ctrl[i] & 0x80)
+                continue;
+            const Entry &e = entries[i];
+            if (e.key_offset <= key_bytes && e.key_len <= key_bytes - e.key_offset)
+                fn(std::string_view(keys + e.key_offset, e.key_len), e.value);
+        }
+    }
+
+    // Copies every entry into a writable Memory or MemoryMT with put();
+    // returns the number stored (fewer if the target has a smaller limit).
+    template<typename Target>
+    size_t copy_into(Target &target) const {
+        size_t stored = 0;
+        for_each([&](std::string_view key, const Value &value) { stored += target.put(key, value); });
+        return stored;
+    }
+
+    size_t size() const { return count; }
+    size_t mapped_bytes() const { return map_len; }
+};
+
+#endif // PATMEMORY_SNAPSHOT_H
@@ -0,0 +1,237 @@
+#ifndef PATMEMORY_STATS_H
+#define PATMEMORY_STATS_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Runtime statistics for Memory and MemoryMT.
+//
+// Sizes, load factor, the byte footprint and the eviction count are kept by
+// the writers and always available, and so are lookups, hits and misses of a
+// table in MemoryGrowth::Evict mode (CacheCounters). The other event
+// counters (probe lengths, failed inserts, lock waits, and hits and misses
+// of other tables) are compiled in only with -DPATMEMORY_STATS, since they
+// are written on the read path; without it MemoryCounters is an empty type
+// whose calls vanish. Both count into one cache-line-sized stripe per thread
+// and stats() sums the stripes, so counting never makes threads share a line
+// (with more threads than stripes, a few share one and the adds stay atomic).
+
+#ifdef PATMEMORY_STATS
+constexpr bool kMemoryStats = true;
+#else
+constexpr bool kMemoryStats = false;
+#endif
+
+constexpr size_t kCounterStripes = 16;
+
+// The calling thread's stripe, assigned round-robin on first use.
+inline size_t counter_stripe() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kCounterStripes;
+    return index;
+}
+
+// Probe lengths in groups, bucketed by powers of two: 1, 2-3, 4-7, ... with
+// the last bucket open-ended.
+constexpr size_t kProbeBuckets = 12;
+
+struct MemoryStats {
+    bool counters = kMemoryStats;   // false: event counts are zero, except a cache's lookups/hits/misses
+
+    size_t entries = 0;
+    size_t max_entries = 0;         // SIZE_MAX when the table grows freely
+    size_t slots = 0;
+    size_t evictions = 0;           // MemoryGrowth::Evict: entries dropped to make room
+    double load_factor = 0;         // (full + deleted) / slots, largest over shards
+
+    size_t bytes_total = 0;         // everything below plus the objects themselves
+    size_t bytes_ctrl = 0;
+    size_t bytes_slots = 0;
+    size_t bytes_keys = 0;          // key arena chunks
+    size_t bytes_retired = 0;       // drained arrays kept for lock-free readers
+
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t inserts = 0;
+    uint64_t failed_inserts = 0;
+    uint64_t erases = 0;
+    uint64_t probe_histogram[kProbeBuckets] = {};
+    uint64_t lock_waits = 0;        // MemoryMT: acquisitions that had to block
+    uint64_t lock_wait_ns = 0;
+    uint64_t optimistic_retries = 0; // MemoryMT: lock-free reads that overlapped a put
+
+    // Adds another table's counts and sizes into this one (for MemoryMT shards).
+    void merge(const MemoryStats &other) {
+        entries += other.entries;
+        slots += other.slots;
+        evictions += other.evictions;
+        load_factor = other.load_factor > load_factor ? other.load_factor : load_factor;
+        bytes_total += other.bytes_total;
+        bytes_ctrl += other.bytes_ctrl;
+        bytes_slots += other.bytes_slots;
+        bytes_keys += other.bytes_keys;
+        bytes_retired += other.bytes_retired;
+        lookups += other.lookups;
+        hits += other.hits;
+        misses += other.misses;
+        inserts += other.inserts;
+        failed_inserts += other.failed_inserts;
+        erases += other.erases;
+        for (size_t i = 0; i < kProbeBuckets; ++i)
+            probe_histogram[i] += other.probe_histogram[i];
+        lock_waits += other.lock_waits;
+        lock_wait_ns += other.lock_wait_ns;
+        optimistic_retries += other.optimistic_retries;
+    }
+
+    std::string to_json() const {
+        std::string out = "{";
+        auto field = [&out](const char* name, const std::string &value) {
+            if (out.size() > 1)
+                out += ", ";
+            out += '"';
+            out += name;
+            out += "\": ";
+            out += value;
+        };
+        field("counters", counters ? "true" : "false");
+        field("entries", std::to_string(entries));
+        field("max_entries", max_entries == SIZE_MAX ? "null" : std::to_string(max_entries));
+        field("slots", std::to_string(slots));
+        field("evictions", std::to_string(evictions));
+        field("load_factor", std::to_string(load_factor));
+        field("bytes_total", std::to_string(bytes_total));
+        field("bytes_ctrl", std::to_string(bytes_ctrl));
+        field("bytes_slots", std::to_string(bytes_slots));
+        field("bytes_keys", std::to_string(bytes_keys));
+        field("bytes_retired", std::to_string(bytes_retired));
+        field("lookups", std::to_string(lookups));
+        field("hits", std::to_string(hits));
+        field("misses", std::to_string(misses));
+        field("inserts", std::to_string(inserts));
+        field("failed_inserts", std::to_string(failed_inserts));
+        field("erases", std::to_string(erases));
+        std::string histogram = "[";
+        for (size_t i = 0; i < kProbeBuckets; ++i)
+            histogram += (i ? ", " : "") + std::to_string(probe_histogram[i]);
+        field("probe_histogram", histogram + "]");
+        field("lock_waits", std::to_string(lock_waits));
+        field("lock_wait_ns", std::to_string(lock_wait_ns));
+        field("optimistic_retries", std::to_string(optimistic_retries));
+        return out + "}";
+    }
+};
+
+#ifdef PATMEMORY_STATS
+
+class MemoryCounters {
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> lookups{0}, hits{0}, inserts{0}, failed_inserts{0}, erases{0};
+        std::atomic<uint64_t> lock_waits{0}, lock_wait_ns{0}, optimistic_retries{0};
+        std::atomic<uint64_t> probes[kProbeBuckets] = {};
+    };
+
+    mutable Stripe stripes[kCounterStripes];
+
+    static void bump(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    Stripe &mine() const { return stripes[counter_stripe()]; }
+
+public:
+    // One probe sequence that visited `groups` groups.
+    void probe(size_t groups) const {
+        size_t bucket = static_cast<size_t>(std::bit_width(groups)) - 1;
+        bump(mine().probes[bucket < kProbeBuckets ? bucket : kProbeBuckets - 1]);
+    }
+    void lookup() const { bump(mine().lookups); }
+    void hit() const { bump(mine().hits); }
+    void insert() const { bump(mine().inserts); }
+    void failed_insert() const { bump(mine().failed_inserts); }
+    void erase() const { bump(mine().erases); }
+    void lock_wait(uint64_t ns) const {
+        Stripe &s = mine();
+        bump(s.lock_waits);
+        bump(s.lock_wait_ns, ns);
+    }
+    void optimistic_retry() const { bump(mine().optimistic_retries); }
+
+    void add_to(MemoryStats &out) const {
+        for (const Stripe &s : stripes) {
+            out.lookups += s.lookups.load(std::memory_order_relaxed);
+            out.hits += s.hits.load(std::memory_order_relaxed);
+            out.inserts += s.inserts.load(std::memory_order_relaxed);
+            out.failed_inserts += s.failed_inserts.load(std::memory_order_relaxed);
+            out.erases += s.erases.load(std::memory_order_relaxed);
+            out.lock_waits += s.lock_waits.load(std::memory_order_relaxed);
+            out.lock_wait_ns += s.lock_wait_ns.load(std::memory_order_relaxed);
+            out.optimistic_retries += s.optimistic_retries.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < kProbeBuckets; ++i)
+                out.probe_histogram[i] += s.probes[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+#else
+
+class MemoryCounters {
+public:
+    void probe(size_t) const {}
+    void lookup() const {}
+    void hit() const {}
+    void insert() const {}
+    void failed_insert() const {}
+    void erase() const {}
+    void lock_wait(uint64_t) const {}
+    void optimistic_retry() const {}
+    void add_to(MemoryStats &) const {}
+};
+
+#endif // PATMEMORY_STATS
+
+// Lookup outcomes of a MemoryGrowth::Evict table, counted in every build
+// since a cache's hit rate is its main figure. The stripes are allocated by
+// enable(), so other tables carry one null pointer.
+class CacheCounters {
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> hits{0}, misses{0};
+    };
+
+    std::unique_ptr<Stripe[]> stripes;
+
+public:
+    void enable() { stripes = std::make_unique<Stripe[]>(kCounterStripes); }
+    size_t bytes() const { return stripes ? kCounterStripes * sizeof(Stripe) : 0; }
+
+    // Counts one lookup if enabled; returns hit.
+    bool tally(bool hit) const {
+        if (stripes) {
+            Stripe &s = stripes[counter_stripe()];
+            (hit ? s.hits : s.misses).fetch_add(1, std::memory_order_relaxed);
+        }
+        return hit;
+    }
+
+    // Replaces the lookup counts of out, which MemoryCounters may also have
+    // filled in: both see every lookup of the table.
+    void add_to(MemoryStats &out) const {
+        if (!stripes)
+            return;
+        out.hits = out.misses = 0;
+        for (size_t i = 0; i < kCounterStripes; ++i) {
+            out.hits += stripes[i].hits.load(std::memory_order_relaxed);
+            out.misses += stripes[i].misses.load(std::memory_order_relaxed);
+        }
+        out.lookups = out.hits + out.misses;
+    }
+};
+
+#endif // PATMEMORY_STATS_H
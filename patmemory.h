@@ -3,60 +3,1155 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <span>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <unordered_set>
+#include <bit>
 #include "pattern.h"
+#include "pattern-hashers.h"
+#include "pattern-threadpool.h"
+#include "patmemory-alloc.h"
+#include "patmemory-stats.h"
+
+// Fixed (the default): the constructor argument is a hard entry limit and put() fails past it.
+// Double: the argument is only the initial size; the table doubles as needed.
+// Evict: the argument is an entry limit, and a put() past it evicts a cold entry.
+enum class MemoryGrowth { Fixed, Double, Evict };
+
+template<typename Value, typename Hasher = PatternKeyHash> class MemorySnapshot;
+template<typename Key, typename Value, typename Hasher, typename Alloc> class BasicMemoryView;
+
+// Keys that BasicMemory stores inside the slot and compares bytewise: no
+// padding or other bytes outside the value (so no float, and no struct with
+// holes). Integers, enums, pointers and std::array<char, N> qualify.
+template<typename Key>
+concept MemoryInlineKey = std::is_trivially_copyable_v<Key> && std::has_unique_object_representations_v<Key>;
+
+// PatternKeyHash for string keys, FixedKeyHash for inline ones.
+template<typename Key>
+using MemoryDefaultHash = std::conditional_t<std::is_same_v<Key, std::string>, PatternKeyHash, FixedKeyHash>;
+
+// Bump allocator for key bytes. Keys are appended to 64 KiB chunks (long keys
+// get a chunk of their own) and never move, so a slot holds a plain pointer
+// and inserting a key costs a memcpy instead of a malloc. Space is reclaimed
+// only wholesale: Memory tracks released bytes and copies the live keys into
+// a fresh arena during a rehash once most of the old one is garbage. Chunks
+// are shared so that a view (BasicMemoryView) can outlive the arena.
+class KeyArena {
+private:
+    static constexpr size_t kChunk = size_t(64) << 10;
+
+    std::vector<std::shared_ptr<char[]>> chunks;
+    char* cursor = nullptr;
+    size_t left = 0;
+    size_t live = 0;      // bytes of keys still referenced
+    size_t dead = 0;      // bytes released by erase
+    size_t reserved = 0;  // bytes allocated in chunks
+
+    char* allocate(size_t bytes) {
+        chunks.push_back(std::make_shared_for_overwrite<char[]>(bytes));
+        reserved += bytes;
+        return chunks.back().get();
+    }
+
+public:
+    // Copies key into the arena; the pointer stays valid until the arena dies.
+    const char* store(std::string_view key) {
+        if (key.empty())
+            return nullptr;
+        char* p;
+        if (key.size() > kChunk / 4) {
+            p = allocate(key.size()); // keep the current chunk for short keys
+        } else {
+            if (key.size() > left) {
+                cursor = allocate(kChunk);
+                left = kChunk;
+            }
+            p = cursor;
+            cursor += key.size();
+            left -= key.size();
+        }
+        std::memcpy(p, key.data(), key.size());
+        live += key.size();
+        return p;
+    }
+
+    void release(size_t bytes) {
+        live -= bytes;
+        dead += bytes;
+    }
+
+    // Adds a reference to every chunk so far; the key bytes they hold never change.
+    void pin(std::vector<std::shared_ptr<const char[]>> &out) const {
+        out.insert(out.end(), chunks.begin(), chunks.end());
+    }
+
+    size_t live_bytes() const { return live; }
+    size_t dead_bytes() const { return dead; }
+    size_t reserved_bytes() const { return reserved; }
+};
+
+// Open-addressing table keyed by the pattern hash, or by any other Hasher
+// from pattern-hashers.h (use FastKeyHash for keys that are not patterns).
+// Memory<Value> is the std::string-keyed table; BasicMemory<Key, Value> also
+// takes any MemoryInlineKey, e.g. BasicMemory<uint64_t, Value> for numeric IDs.
+// Slots come in groups of 16 with one control byte each (kEmpty, kDeleted or
+// a 7-bit hash tag), probed a group at a time from the hash's home group.
+// README.md ("Memory tables") covers rehashing, eviction and views.
+template<typename Key, typename Value, typename Hasher = MemoryDefaultHash<Key>,
+         typename Alloc = std::allocator<uint8_t>>
+class BasicMemory {
+    static_assert(std::is_same_v<Key, std::string> || MemoryInlineKey<Key>,
+                  "keys are std::string or trivially copyable without padding");
+
+private:
+    template<typename, typename> friend class MemorySnapshot; // reuses the probe layout
+    template<typename, typename, typename, typename> friend class BasicMemoryView;
+    static constexpr size_t kGroup = 16;
+    static constexpr uint8_t kEmpty = 0x80;
+    static constexpr uint8_t kDeleted = 0xFE;
+    static constexpr size_t kMigrateGroups = 2;
+    static constexpr double kDefaultMaxLoad = 0.875;
+    static constexpr uint64_t kFibonacci = 0x9E3779B97F4A7C15ULL;
+    static constexpr size_t kBatch = 16;    // keys in flight per get_many/put_many step
+    static constexpr size_t kCompactBytes = size_t(1) << 20; // dead key bytes worth a compaction
+    static constexpr size_t kSpareMinGroups = 256; // smaller arrays are allocated in place
+    static constexpr size_t kViewGroups = 64;      // groups per view segment
+
+    static constexpr bool kInlineKey = !std::is_same_v<Key, std::string>;
+    static constexpr bool kViewable = std::is_copy_assignable_v<Value>;
+
+    // Home group among 2^(64 - shift) groups: the top bits of a Fibonacci multiply.
+    static size_t group_at(uint64_t hash, unsigned shift) {
+        return static_cast<size_t>((hash * kFibonacci) >> shift);
+    }
+
+public:
+    // Table geometry for tools that model where keys land (see
+    // analyze_key_distribution): slots per group, the group count of a table
+    // sized for `entries`, and a hash's home group among `groups`.
+    static constexpr size_t kGroupSlots = kGroup;
+
+    static size_t groups_for(size_t entries, double load = kDefaultMaxLoad) {
+        size_t groups = 1;
+        while (static_cast<double>(groups * kGroup) * load < static_cast<double>(entries))
+            groups <<= 1;
+        return groups;
+    }
+
+    static size_t home_group(uint64_t hash, size_t groups) {
+        return groups == 1 ? 0 : group_at(hash, 64 - static_cast<unsigned>(std::countr_zero(groups)));
+    }
+
+    // What the API takes and for_each() hands out: std::string_view for
+    // string keys, the key by value otherwise.
+    using KeyRef = std::conditional_t<kInlineKey, Key, std::string_view>;
 
-template<typename Value>
-class Memory {
 private:
-    struct Entry {
-        std::string key;
+    struct ArenaSlot {
+        uint64_t hash;
+        const char* key;  // key_len bytes in the arena (nullptr when empty)
+        size_t key_len;
+        Value value;
+        ArenaSlot() noexcept(std::is_nothrow_default_constructible_v<Value>) : hash(0), key(nullptr), key_len(0), value() {}
+
+        std::string_view key_view() const { return {key, key_len}; }
+    };
+
+    struct InlineSlot {
+        Key key;
         Value value;
-        bool used;
-        Entry() : key(""), value(), used(false) {}
+        InlineSlot() noexcept(std::is_nothrow_default_constructible_v<Value>) : key(), value() {}
+
+        Key key_view() const { return key; }
+    };
+
+    using Slot = std::conditional_t<kInlineKey, InlineSlot, ArenaSlot>;
+
+    struct Frozen;
+
+    struct Table {
+        MemoryArray<uint8_t, Alloc> ctrl; // one control byte per slot
+        MemoryArray<Slot, Alloc> slots;
+        size_t group_mask = 0;      // group count - 1
+        unsigned group_shift = 64;  // 64 - log2(group count)
+        size_t used = 0;            // full slots
+        size_t tombstones = 0;
+        mutable MemoryArray<uint8_t, Alloc> referenced; // Evict only: CLOCK bit per slot, set by hits
+        size_t hand = 0;            // Evict only: next slot the CLOCK sweep looks at
+        std::vector<std::shared_ptr<Frozen>> views; // views still copying from this array
+
+        Table() = default;
+        explicit Table(size_t groups, bool clock = false)
+            : ctrl(groups * kGroup, kEmpty), slots(groups * kGroup), group_mask(groups - 1),
+              referenced(clock ? groups * kGroup : 0, uint8_t(0)) {
+            while (groups > 1) {
+                groups >>= 1;
+                --group_shift;
+            }
+        }
+
+        size_t home_group(uint64_t hash) const {
+            return group_mask == 0 ? 0 : group_at(hash, group_shift);
+        }
+
+        size_t slot_count() const { return ctrl.size(); }
+        size_t group_count() const { return group_mask + 1; }
+    };
+
+    // One array as it was when a view was taken. Its groups are copied into
+    // segments of kViewGroups groups on first need: by a writer just before
+    // it changes the group, or by the view when it reaches the segment.
+    // Either way under `mutex`, so a group is copied once and never while
+    // it is being changed. The array is not freed before every group is copied.
+    struct Frozen {
+        const Table* live;
+        size_t groups;
+        size_t segment_groups;
+        std::unique_ptr<std::atomic<uint8_t>[]> copied;     // per group, set once its copy is complete
+        std::unique_ptr<std::unique_ptr<Table>[]> segments; // made on first copy; guarded by mutex
+        std::mutex mutex;
+        std::atomic<size_t> left;                           // groups not copied yet
+        std::atomic<bool> abandoned;                        // the view is gone; nothing more to copy
+
+        explicit Frozen(const Table &t)
+            : live(&t), groups(t.group_count()), segment_groups(std::min(kViewGroups, t.group_count())),
+              copied(std::make_unique<std::atomic<uint8_t>[]>(groups)),
+              segments(std::make_unique<std::unique_ptr<Table>[]>(groups / segment_groups)),
+              left(groups), abandoned(false) {}
+
+        size_t segment_count() const { return groups / segment_groups; }
+
+        // Caller holds mutex.
+        void copy_group(size_t group) {
+            if (copied[group].load(std::memory_order_relaxed))
+                return;
+            std::unique_ptr<Table> &segment = segments[group / segment_groups];
+            if (!segment)
+                segment = std::make_unique<Table>(segment_groups);
+            size_t from = group * kGroup, to = (group % segment_groups) * kGroup;
+            for (size_t i = 0; i < kGroup; ++i) {
+                uint8_t c = live->ctrl[from + i];
+                segment->ctrl[to + i] = c;
+                if (!(c & 0x80))
+                    segment->slots[to + i] = live->slots[from + i];
+            }
+            left.fetch_sub(1, std::memory_order_acq_rel);
+            copied[group].store(1, std::memory_order_release);
+        }
+
+        void copy_all() {
+            std::lock_guard lock(mutex);
+            if (!abandoned.load(std::memory_order_relaxed))
+                for (size_t g = 0; g < groups; ++g)
+                    copy_group(g);
+        }
+
+        // The view's side: copies what segment s still lacks. The segment
+        // never changes afterwards, so it is read without the lock.
+        template<typename Fn>
+        void visit(size_t s, Fn &fn) {
+            size_t first = s * segment_groups, end = first + segment_groups;
+            bool complete = true;
+            for (size_t g = first; g < end; ++g)
+                complete = copied[g].load(std::memory_order_acquire) && complete;
+            if (!complete) {
+                std::lock_guard lock(mutex);
+                for (size_t g = first; g < end; ++g)
+                    copy_group(g);
+            }
+            const Table &segment = *segments[s];
+            for (size_t i = 0; i < segment.slot_count(); ++i)
+                if (!(segment.ctrl[i] & 0x80))
+                    fn(segment.slots[i].key_view(), segment.slots[i].value);
+        }
+
+        void abandon() {
+            std::lock_guard lock(mutex);
+            abandoned.store(true, std::memory_order_release);
+            segments.reset();
+        }
     };
 
-    std::vector<Entry> table;  // Declared first...
-    size_t capacity;           // ...then capacity
+    std::unique_ptr<Table> table;
+    std::unique_ptr<Table> old;             // drained into `table` while non-null
+    std::unique_ptr<Table> spare;           // allocated ahead of the next rehash (give_spare)
+    std::vector<std::unique_ptr<Table>> retired; // drained arrays kept for optimistic readers
+    std::atomic<const Table*> published;    // `table` and `old` as seen by lock-free readers
+    std::atomic<const Table*> published_old;
+    KeyArena arena;             // bytes of every key in `table` (string keys only)
+    KeyArena old_arena;         // keys of `old` while a rehash compacts the arena
+    bool compacting;            // migration copies keys into `arena`
+    bool stable_keys;           // set by enable_optimistic_reads()
+    size_t migrate_next;        // next group of `old` to move
+    size_t capacity;            // entry limit (SIZE_MAX when growing)
+    MemoryGrowth growth;
+    double max_load;
+    size_t count;
+    size_t evicted;             // entries dropped by the CLOCK sweep
+    [[no_unique_address]] Hasher hasher;
+    [[no_unique_address]] MemoryCounters counters; // empty unless PATMEMORY_STATS
+    CacheCounters cache_counters; // Evict only: hits and misses in every build
+
+    size_t threshold(const Table &t) const {
+        size_t limit = static_cast<size_t>(static_cast<double>(t.slot_count()) * max_load);
+        return limit > 0 ? limit : 1;
+    }
+
+    static uint8_t tag_of(uint64_t hash) { return static_cast<uint8_t>(hash & 0x7F); }
+
+    uint64_t hash_of(const Slot &slot) const {
+        if constexpr (kInlineKey)
+            return hasher(slot.key);
+        else
+            return slot.hash;
+    }
+
+    static bool holds(const Slot &slot, KeyRef key, uint64_t hash) {
+        if constexpr (kInlineKey)
+            return std::memcmp(&slot.key, &key, sizeof(Key)) == 0; // one compare for word-sized keys
+        else
+            return slot.hash == hash && slot.key_view() == key;
+    }
+
+    // The key as place() wants it: string keys are copied into the arena.
+    KeyRef intern(KeyRef key) {
+        if constexpr (kInlineKey)
+            return key;
+        else
+            return {arena.store(key), key.size()};
+    }
+
+    bool evicting() const { return growth == MemoryGrowth::Evict; }
+
+    // Marks a hit for the CLOCK sweep. Concurrent readers (MemoryMT's shared
+    // lock) may all store the same 1, so the byte is accessed atomically.
+    void touch(const Table &t, size_t index) const {
+        if (evicting() && !__atomic_load_n(&t.referenced[index], __ATOMIC_RELAXED))
+            __atomic_store_n(&t.referenced[index], uint8_t(1), __ATOMIC_RELAXED);
+    }
+
+    // Before the first change to a group of t while views hold t: copies the
+    // group into each of them, and drops views that are complete or gone.
+    static void preserve(Table &t, size_t group) {
+        if constexpr (kViewable) {
+            if (t.views.empty())
+                return;
+            std::erase_if(t.views, [group](const std::shared_ptr<Frozen> &f) {
+                // acquire: the view's earlier reads of t come before our writes
+                if (f->left.load(std::memory_order_acquire) == 0 || f->abandoned.load(std::memory_order_acquire))
+                    return true;
+                if (!f->copied[group].load(std::memory_order_acquire)) {
+                    std::lock_guard lock(f->mutex);
+                    if (!f->abandoned.load(std::memory_order_relaxed))
+                        f->copy_group(group);
+                }
+                return false;
+            });
+        }
+    }
+
+    // t is about to be freed: views still reading it get the rest now.
+    static void release_views(Table &t) {
+        for (const auto &f : t.views)
+            f->copy_all();
+        t.views.clear();
+    }
+
+    // Bit i set where group[i] == byte, for one group of 16 control bytes.
+    static uint32_t group_match(const uint8_t* group, uint8_t byte) {
+#ifdef PATTERN_X86_64
+        __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(static_cast<char>(byte)))));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < kGroup; ++i)
+            bits |= uint32_t(group[i] == byte) << i;
+        return bits;
+#endif
+    }
+
+    // Bit i set where group[i] is empty or deleted (high bit of the control byte).
+    static uint32_t group_free(const uint8_t* group) {
+#ifdef PATTERN_X86_64
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < kGroup; ++i)
+            bits |= uint32_t(group[i] >> 7) << i;
+        return bits;
+#endif
+    }
+
+    // Index of key's slot in t, or SIZE_MAX. If absent and `insert_at` is given,
+    // it receives the first free slot on the probe path (SIZE_MAX if none).
+    size_t find_in(const Table &t, KeyRef key, uint64_t hash, size_t* insert_at = nullptr) const {
+        size_t first_free = SIZE_MAX;
+        uint8_t tag = tag_of(hash);
+        size_t group = t.home_group(hash);
+        size_t probed = 0;
+        while (probed <= t.group_mask) {
+            const uint8_t* g = &t.ctrl[group * kGroup];
+            for (uint32_t match = group_match(g, tag); match != 0; match &= match - 1) {
+                size_t index = group * kGroup + static_cast<size_t>(__builtin_ctz(match));
+                if (holds(t.slots[index], key, hash)) {
+                    counters.probe(probed + 1);
+                    return index;
+                }
+            }
+            uint32_t free = group_free(g);
+            if (first_free == SIZE_MAX && free != 0)
+                first_free = group * kGroup + static_cast<size_t>(__builtin_ctz(free));
+            ++probed;
+            if (group_match(g, kEmpty) != 0)
+                break;
+            group = (group + 1) & t.group_mask;
+        }
+        counters.probe(probed);
+        if (insert_at)
+            *insert_at = first_free;
+        return SIZE_MAX;
+    }
+
+    // find_in() for a reader racing the writer. The group scan may see stale
+    // tags; a candidate is trusted only once an acquire load confirms its tag,
+    // which pairs with the release in place() and guarantees a complete key.
+    size_t find_published(const Table &t, KeyRef key, uint64_t hash) const {
+        uint8_t tag = tag_of(hash);
+        size_t group = t.home_group(hash);
+        size_t probed = 0;
+        while (probed <= t.group_mask) {
+            const uint8_t* g = &t.ctrl[group * kGroup];
+            for (uint32_t match = group_match(g, tag); match != 0; match &= match - 1) {
+                size_t index = group * kGroup + static_cast<size_t>(__builtin_ctz(match));
+                if (__atomic_load_n(&t.ctrl[index], __ATOMIC_ACQUIRE) != tag)
+                    continue;
+                if (holds(t.slots[index], key, hash)) {
+                    counters.probe(probed + 1);
+                    return index;
+                }
+            }
+            ++probed;
+            if (group_match(g, kEmpty) != 0)
+                break;
+            group = (group + 1) & t.group_mask;
+        }
+        counters.probe(probed);
+        return SIZE_MAX;
+    }
+
+    // First free slot on hash's probe path; the caller guarantees one exists.
+    static size_t free_slot(const Table &t, uint64_t hash) {
+        size_t group = t.home_group(hash);
+        for (;;) {
+            uint32_t free = group_free(&t.ctrl[group * kGroup]);
+            if (free != 0)
+                return group * kGroup + static_cast<size_t>(__builtin_ctz(free));
+            group = (group + 1) & t.group_mask;
+        }
+    }
+
+    // Fills slot `index` with an intern()ed key and publishes its tag.
+    static void place(Table &t, size_t index, uint64_t hash, KeyRef key, Value &&value) {
+        preserve(t, index / kGroup);
+        if (t.ctrl[index] == kDeleted)
+            --t.tombstones;
+        Slot &slot = t.slots[index];
+        if constexpr (kInlineKey) {
+            slot.key = key;
+        } else {
+            slot.hash = hash;
+            slot.key = key.data();
+            slot.key_len = key.size();
+        }
+        slot.value = std::move(value);
+        __atomic_store_n(&t.ctrl[index], tag_of(hash), __ATOMIC_RELEASE);
+        ++t.used;
+    }
+
+    void remove_at(Table &t, size_t index) {
+        preserve(t, index / kGroup);
+        const uint8_t* group = &t.ctrl[index & ~(kGroup - 1)];
+        bool reusable = group_match(group, kEmpty) != 0;
+        Slot &slot = t.slots[index];
+        t.ctrl[index] = reusable ? kEmpty : kDeleted;
+        if constexpr (!kInlineKey) {
+            (compacting && &t == old.get() ? old_arena : arena).release(slot.key_len);
+            slot.key = nullptr;
+            slot.key_len = 0;
+        }
+        slot.value = Value();
+        --t.used;
+        if (!reusable)
+            ++t.tombstones;
+        if (!t.referenced.empty())
+            t.referenced[index] = 0;
+    }
+
+    // Evicts the first entry past the hand whose reference bit is clear,
+    // clearing the bits it passes. During a rehash the old array goes first
+    // while most of it is undrained; past that the new array is the denser.
+    void evict_one() {
+        Table* dense = old && migrate_next <= old->group_mask / 2 ? old.get() : table.get();
+        for (Table* t : {dense, dense == old.get() ? table.get() : old.get()})
+            if (t && evict_in(*t))
+                return;
+    }
+
+    // The hand visits slots in a fixed odd-stride order (kFibonacci) rather than
+    // left to right: a linear sweep leaves its holes trailing the hand and a
+    // full run ahead of it, which long probe sequences then have to cross.
+    // False if t holds no entry; two passes at most, the first clears every bit.
+    bool evict_in(Table &t) {
+        size_t mask = t.slot_count() - 1;
+        for (size_t step = 0; step < 2 * t.slot_count(); ++step) {
+            size_t index = (t.hand++ * kFibonacci) & mask;
+            if (t.ctrl[index] & 0x80)
+                continue;
+            if (t.referenced[index]) {
+                t.referenced[index] = 0;
+                continue;
+            }
+            remove_at(t, index);
+            --count;
+            ++evicted;
+            return true;
+        }
+        return false;
+    }
+
+    // Once released keys are most of the arena, a rehash at the same size
+    // copies the live ones into a fresh arena.
+    void compact_keys_if_worthwhile() {
+        if (!old && !stable_keys && arena.dead_bytes() >= kCompactBytes && arena.dead_bytes() > arena.live_bytes())
+            start_rehash(table->group_count());
+    }
+
+    // Moves up to `groups` groups of the old array into the current one.
+    void migrate(size_t groups) {
+        for (; groups > 0 && old; --groups) {
+            preserve(*old, migrate_next);
+            for (size_t i = migrate_next * kGroup, end = i + kGroup; i < end; ++i) {
+                if (old->ctrl[i] & 0x80)
+                    continue;
+                Slot &slot = old->slots[i];
+                uint64_t hash = hash_of(slot);
+                KeyRef key = compacting ? intern(slot.key_view()) : slot.key_view();
+                // A lock-free reader may still be reading the old value.
+                Value value = stable_keys ? Value(slot.value) : Value(std::move(slot.value));
+                size_t at = free_slot(*table, hash);
+                place(*table, at, hash, key, std::move(value));
+                if (evicting())
+                    table->referenced[at] = old->referenced[i];
+                __atomic_store_n(&old->ctrl[i], kDeleted, __ATOMIC_RELAXED);
+            }
+            if (++migrate_next > old->group_mask) {
+                published_old.store(nullptr, std::memory_order_release);
+                release_views(*old);
+                if (stable_keys)
+                    retired.push_back(std::move(old));
+                old.reset();
+                if (compacting) {
+                    old_arena = KeyArena();
+                    compacting = false;
+                }
+                migrate_next = 0;
+            }
+        }
+    }
+
+    // Starts an incremental rehash into a table of `groups` groups.
+    void start_rehash(size_t groups) {
+        migrate(SIZE_MAX); // finish any earlier rehash first
+        if (!stable_keys && arena.dead_bytes() > arena.live_bytes()) {
+            // Every live key is about to migrate anyway; copy it into a fresh arena.
+            old_arena = std::move(arena);
+            arena = KeyArena();
+            compacting = true;
+        }
+        old = std::move(table);
+        if (spare && spare->group_count() == groups)
+            table = std::move(spare);
+        else
+            table = std::make_unique<Table>(groups, evicting());
+        spare.reset();
+        published_old.store(old.get(), std::memory_order_release);
+        published.store(table.get(), std::memory_order_release);
+        migrate_next = 0;
+    }
+
+    // The array and slot holding key, or {nullptr, SIZE_MAX}.
+    std::pair<Table*, size_t> locate(KeyRef key) const {
+        uint64_t hash = hasher(key);
+        counters.lookup();
+        for (Table* t : {table.get(), old.get()}) {
+            size_t index = t ? find_in(*t, key, hash) : SIZE_MAX;
+            if (index != SIZE_MAX) {
+                counters.hit();
+                cache_counters.tally(true);
+                touch(*t, index);
+                return {t, index};
+            }
+        }
+        cache_counters.tally(false);
+        return {nullptr, SIZE_MAX};
+    }
+
+    template<typename K>
+    size_t get_many_impl(std::span<const K> keys, std::span<Value> values_out, std::span<bool> found) const {
+        uint64_t hashes[kBatch];
+        size_t hits = 0;
+        for (size_t base = 0; base < keys.size(); base += kBatch) {
+            size_t n = std::min(kBatch, keys.size() - base);
+            hash_keys(hasher, keys.subspan(base, n), hashes);
+            for (size_t i = 0; i < n; ++i)
+                prefetch_group(hashes[i]);
+            for (size_t i = 0; i < n; ++i)
+                prefetch_slot(hashes[i]);
+            for (size_t i = 0; i < n; ++i) {
+                bool hit = get_hashed(keys[base + i], hashes[i], values_out[base + i]);
+                if (!found.empty())
+                    found[base + i] = hit;
+                hits += hit;
+            }
+        }
+        return hits;
+    }
+
+    template<typename K>
+    size_t put_many_impl(std::span<const K> keys, std::span<const Value> values, std::span<bool> stored) {
+        uint64_t hashes[kBatch];
+        size_t done = 0;
+        for (size_t base = 0; base < keys.size(); base += kBatch) {
+            size_t n = std::min(kBatch, keys.size() - base);
+            hash_keys(hasher, keys.subspan(base, n), hashes);
+            for (size_t i = 0; i < n; ++i)
+                prefetch_group(hashes[i]);
+            for (size_t i = 0; i < n; ++i)
+                prefetch_slot(hashes[i]);
+            for (size_t i = 0; i < n; ++i) {
+                bool ok = put_hashed(keys[base + i], hashes[i], values[base + i]);
+                if (!stored.empty())
+                    stored[base + i] = ok;
+                done += ok;
+            }
+        }
+        return done;
+    }
+
+    // Size of the array an insert would rehash into if it crossed the threshold now.
+    size_t next_rehash_groups() const {
+        // Double only when live entries need it; otherwise purge tombstones.
+        return count + 1 > threshold(*table) / 2 && growth == MemoryGrowth::Double ? table->group_count() * 2
+                                                                                 : target_groups(count + 1);
+    }
+
+    size_t target_groups(size_t entries) const {
+        bool fixed = growth != MemoryGrowth::Double;
+        size_t groups = groups_for(fixed ? capacity : entries, max_load);
+        return groups > table->group_count() || fixed ? groups : table->group_count();
+    }
 
 public:
-    // Reorder initializer list to match declaration order
-    Memory(size_t cap) : table(cap), capacity(cap) {}
-
-    // Insert (returns true on success, false if full)
-    bool put(const std::string &key, const Value &value) {
-        uint64_t hash = hash_function_64(key.c_str(), key.size());
-        size_t index = hash % capacity;
-        size_t start = index;
-        // Use linear probing to resolve collisions.
-        do {
-            if (!table[index].used || table[index].key == key) {
-                table[index].key = key;
-                table[index].value = value;
-                table[index].used = true;
+    BasicMemory(size_t cap, MemoryGrowth growth = MemoryGrowth::Fixed, Hasher hasher = Hasher())
+        : table(std::make_unique<Table>(groups_for(cap, kDefaultMaxLoad), growth == MemoryGrowth::Evict)),
+          published(table.get()),
+          published_old(nullptr),
+          compacting(false),
+          stable_keys(false),
+          migrate_next(0),
+          capacity(growth == MemoryGrowth::Double ? SIZE_MAX : cap),
+          growth(growth),
+          max_load(kDefaultMaxLoad),
+          count(0),
+          evicted(0),
+          hasher(std::move(hasher)) {
+        if (growth == MemoryGrowth::Evict)
+            cache_counters.enable();
+    }
+
+    ~BasicMemory() {
+        for (Table* t : {table.get(), old.get()})
+            if (t)
+                release_views(*t);
+    }
+
+    // Insert or update (returns true on success, false if a Fixed table is full;
+    // an Evict table makes room instead)
+    bool put(KeyRef key, const Value &value) {
+        return put_hashed(key, hasher(key), value);
+    }
+
+    bool put(KeyRef key, Value &&value) {
+        return put_hashed(key, hasher(key), std::move(value));
+    }
+
+    // Constructs Value(args...) only if key is absent. Returns the entry and
+    // whether it was inserted; {nullptr, false} if a Fixed table is full.
+    template<typename... Args>
+    std::pair<Value*, bool> try_emplace(KeyRef key, Args &&...args) {
+        return emplace_hashed(key, hasher(key), [] { return true; },
+                              [&] { return Value(std::forward<Args>(args)...); });
+    }
+
+    // Retrieve value; returns true if found.
+    bool get(KeyRef key, Value &value_out) const {
+        return get_hashed(key, hasher(key), value_out);
+    }
+
+    // Pointer to key's value, or nullptr. Valid until the next insert or erase.
+    Value* find(KeyRef key) {
+        auto [t, index] = locate(key);
+        if (!t)
+            return nullptr;
+        preserve(*t, index / kGroup); // the caller may write through it
+        return &t->slots[index].value;
+    }
+
+    const Value* find(KeyRef key) const {
+        auto [t, index] = locate(key);
+        return t ? &t->slots[index].value : nullptr;
+    }
+
+    // Batched get(): hashes kBatch keys, prefetches their home groups, then
+    // the slots whose tags match, and only then probes, so the cache misses of
+    // a whole batch overlap instead of running back to back. values_out (and
+    // found, unless empty) must hold keys.size() elements. Returns the hit count.
+    size_t get_many(std::span<const std::string> keys, std::span<Value> values_out,
+                    std::span<bool> found = {}) const requires (!kInlineKey) {
+        return get_many_impl(keys, values_out, found);
+    }
+
+    size_t get_many(std::span<const KeyRef> keys, std::span<Value> values_out,
+                    std::span<bool> found = {}) const {
+        return get_many_impl(keys, values_out, found);
+    }
+
+    // Batched put() with the same prefetching; keys are stored in order, so a
+    // repeated key keeps its last value. stored (unless empty) gets put()'s
+    // result per key. Returns the number of keys stored.
+    size_t put_many(std::span<const std::string> keys, std::span<const Value> values,
+                    std::span<bool> stored = {}) requires (!kInlineKey) {
+        return put_many_impl(keys, values, stored);
+    }
+
+    size_t put_many(std::span<const KeyRef> keys, std::span<const Value> values,
+                    std::span<bool> stored = {}) {
+        return put_many_impl(keys, values, stored);
+    }
+
+    // Calls fn(key, value) for every entry, in no particular order.
+    template<typename Fn>
+    void for_each(Fn &&fn) const {
+        for (const Table* t : {table.get(), old.get()})
+            if (t)
+                for (size_t i = 0; i < t->slot_count(); ++i)
+                    if (!(t->ctrl[i] & 0x80))
+                        fn(t->slots[i].key_view(), t->slots[i].value);
+    }
+
+    // Point-in-time view of the entries (see BasicMemoryView). Taking it
+    // allocates a little bookkeeping per array and copies nothing yet.
+    BasicMemoryView<Key, Value, Hasher, Alloc> view() {
+        BasicMemoryView<Key, Value, Hasher, Alloc> v;
+        add_to_view(v);
+        return v;
+    }
+
+    // Adds the entries as they are now to v; MemoryMT calls it for every
+    // shard while it holds all of their locks.
+    void add_to_view(BasicMemoryView<Key, Value, Hasher, Alloc> &v) {
+        static_assert(kViewable, "views copy values");
+        for (Table* t : {table.get(), old.get()}) {
+            if (t) {
+                auto part = std::make_shared<Frozen>(*t);
+                t->views.push_back(part);
+                v.parts.push_back(std::move(part));
+            }
+        }
+        if constexpr (!kInlineKey) {
+            arena.pin(v.keys);
+            old_arena.pin(v.keys);
+        }
+        v.count += count;
+    }
+
+    // Remove key; returns true if it was present.
+    bool erase(KeyRef key) {
+        return erase_hashed(key, hasher(key));
+    }
+
+    // Variants for callers that already hashed the key (e.g. MemoryMT shards).
+    template<typename V>
+    bool put_hashed(KeyRef key, uint64_t hash, V &&value) {
+        return put_hashed(key, hash, std::forward<V>(value), [] { return true; });
+    }
+
+    // `admit()` runs only when key is new and may veto the insert; MemoryMT
+    // uses it to enforce one entry limit across all of its shards.
+    template<typename V, typename Admit>
+    bool put_hashed(KeyRef key, uint64_t hash, V &&value, Admit &&admit) {
+        auto [entry, inserted] = emplace_hashed(key, hash, std::forward<Admit>(admit),
+                                                [&] { return Value(std::forward<V>(value)); });
+        if (entry && !inserted)
+            *entry = std::forward<V>(value);
+        return entry != nullptr;
+    }
+
+    // Core insert: finds key or claims a slot for it, filling the slot with
+    // make() only when the key is new so lock-free readers never see a slot
+    // without its value. Returns {entry, inserted}, or {nullptr, false} if
+    // the table is full or admit() refused.
+    template<typename Admit, typename Make>
+    std::pair<Value*, bool> emplace_hashed(KeyRef key, uint64_t hash, Admit &&admit, Make &&make) {
+        migrate(kMigrateGroups);
+        size_t insert_at = SIZE_MAX;
+        size_t index = find_in(*table, key, hash, &insert_at);
+        if (index != SIZE_MAX) {
+            touch(*table, index);
+            preserve(*table, index / kGroup); // the caller may write through the entry
+            return {&table->slots[index].value, false};
+        }
+        size_t old_index = old ? find_in(*old, key, hash) : SIZE_MAX;
+        if (old_index != SIZE_MAX) {
+            touch(*old, old_index);
+            preserve(*old, old_index / kGroup);
+            return {&old->slots[old_index].value, false};
+        }
+        bool full = count >= capacity;
+        if ((full && (!evicting() || count == 0)) || !admit()) {
+            counters.failed_insert();
+            return {nullptr, false}; // Table is full.
+        }
+        if (full)
+            evict_one(); // frees a slot; insert_at, if any, stays free
+        bool consumes_empty = insert_at == SIZE_MAX || table->ctrl[insert_at] == kEmpty;
+        if (insert_at == SIZE_MAX ||
+            (consumes_empty && table->used + table->tombstones + 1 > threshold(*table))) {
+            start_rehash(next_rehash_groups());
+            migrate(kMigrateGroups);
+            insert_at = free_slot(*table, hash);
+        }
+        place(*table, insert_at, hash, intern(key), make());
+        ++count;
+        counters.insert();
+        Value* entry = &table->slots[insert_at].value;
+        if (full)
+            compact_keys_if_worthwhile(); // keeps `entry` alive: the array only moves to `old`
+        return {entry, true};
+    }
+
+    bool get_hashed(KeyRef key, uint64_t hash, Value &value_out) const {
+        counters.lookup();
+        for (const Table* t : {table.get(), old.get()}) {
+            size_t index = t ? find_in(*t, key, hash) : SIZE_MAX;
+            if (index != SIZE_MAX) {
+                counters.hit();
+                cache_counters.tally(true);
+                touch(*t, index);
+                value_out = t->slots[index].value;
                 return true;
             }
-            index = (index + 1) % capacity;
-        } while (index != start);
-        return false; // Table is full.
+        }
+        return cache_counters.tally(false);
     }
 
-    // Retrieve value; returns true if found.
-    bool get(const std::string &key, Value &value_out) {
-        uint64_t hash = hash_function_64(key.c_str(), key.size());
-        size_t index = hash % capacity;
-        size_t start = index;
-        while (table[index].used) {
-            if (table[index].key == key) {
-                value_out = table[index].value;
+    // Prefetch hints for batched callers. Both go through the published arrays,
+    // so MemoryMT may issue them without the shard lock once optimistic reads
+    // are enabled. prefetch_slot() reads the home group's control bytes and
+    // should follow prefetch_group() by a few keys.
+    void prefetch_group(uint64_t hash) const {
+        for (const std::atomic<const Table*>* view : {&published, &published_old})
+            if (const Table* t = view->load(std::memory_order_acquire))
+                __builtin_prefetch(&t->ctrl[t->home_group(hash) * kGroup]);
+    }
+
+    void prefetch_slot(uint64_t hash) const {
+        const Table* t = published.load(std::memory_order_acquire);
+        size_t group = t->home_group(hash);
+        uint32_t match = group_match(&t->ctrl[group * kGroup], tag_of(hash));
+        if (match != 0)
+            __builtin_prefetch(&t->slots[group * kGroup + static_cast<size_t>(__builtin_ctz(match))]);
+    }
+
+    // Lock-free lookup that may run concurrently with one writer. Needs
+    // enable_optimistic_reads() and a trivially copyable Value; the answer is
+    // only meaningful if the caller's version check shows no write overlapped.
+    bool get_optimistic(KeyRef key, uint64_t hash, Value &value_out) const {
+        static_assert(std::is_trivially_copyable_v<Value>, "optimistic reads copy values bytewise");
+        counters.lookup();
+        for (const std::atomic<const Table*>* view : {&published, &published_old}) {
+            const Table* t = view->load(std::memory_order_acquire);
+            if (!t)
+                continue;
+            size_t index = find_published(*t, key, hash);
+            if (index != SIZE_MAX) {
+                counters.hit();
+                touch(*t, index);
+                std::memcpy(static_cast<void*>(&value_out), &t->slots[index].value, sizeof(Value));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A slot array made ahead of a rehash. Allocating and clearing the array
+    // is the one step of a rehash that is proportional to the table, so
+    // MemoryMT has it done on another thread and hands it in under the lock.
+    class Spare {
+        std::unique_ptr<Table> array;
+        friend class BasicMemory;
+    };
+
+    static Spare make_spare(size_t groups, bool evict) {
+        Spare s;
+        s.array = std::make_unique<Table>(groups, evict);
+        return s;
+    }
+
+    // Group count for make_spare() once the table is within a quarter of its
+    // rehash threshold; 0 while it is not, while a spare is held or a rehash
+    // runs, or when the array is small enough to allocate in place.
+    size_t spare_wanted() const {
+        if (spare || old)
+            return 0;
+        size_t limit = threshold(*table);
+        if (table->used + table->tombstones < limit - limit / 4)
+            return 0;
+        size_t groups = next_rehash_groups();
+        return groups >= kSpareMinGroups ? groups : 0;
+    }
+
+    // Keeps s for the next rehash; dropped if that rehash picks another size.
+    void give_spare(Spare &&s) {
+        if (!old && !spare)
+            spare = std::move(s.array);
+    }
+
+    // One incremental step of a running rehash, for callers that have the
+    // table to themselves but nothing to insert.
+    void migrate_step() { migrate(kMigrateGroups); }
+
+    // Whether a rehash is running; safe to call racing the writer.
+    bool migrating() const { return published_old.load(std::memory_order_relaxed) != nullptr; }
+
+    bool erase_hashed(KeyRef key, uint64_t hash) {
+        migrate(kMigrateGroups);
+        for (Table* t : {table.get(), old.get()}) {
+            size_t index = t ? find_in(*t, key, hash) : SIZE_MAX;
+            if (index != SIZE_MAX) {
+                remove_at(*t, index);
+                --count;
+                counters.erase();
+                // Erases that never leave tombstones never trigger a rehash either.
+                compact_keys_if_worthwhile();
                 return true;
             }
-            index = (index + 1) % capacity;
-            if (index == start)
-                break;
         }
         return false;
     }
+
+    // Fraction of slots (full + deleted) allowed before a rehash, in (0, 1].
+    void set_max_load_factor(double load) {
+        max_load = load < 0.05 ? 0.05 : (load > 1.0 ? 1.0 : load);
+        size_t groups = target_groups(count);
+        if (groups != table->group_count() || table->used + table->tombstones > threshold(*table))
+            start_rehash(groups);
+    }
+
+    // Switches to the layout get_optimistic() relies on: nothing a reader can
+    // reach is moved or freed once published. Values are copied rather than
+    // moved on migration, drained arrays (under one current table's worth)
+    // stay alive and the key arena is never compacted. erase() and Evict
+    // mode recycle published keys and must not be mixed with optimistic readers.
+    void enable_optimistic_reads() { stable_keys = true; }
+
+    double max_load_factor() const { return max_load; }
+    double load_factor() const {
+        return static_cast<double>(table->used + table->tombstones) / static_cast<double>(table->slot_count());
+    }
+
+    size_t size() const { return count; }
+    size_t max_size() const { return capacity; }
+    size_t evictions() const { return evicted; }
+    size_t slot_count() const { return table->slot_count(); }
+    size_t key_bytes() const { return arena.reserved_bytes() + old_arena.reserved_bytes(); }
+    bool rehashing() const { return old != nullptr; }
+
+    // Sizes and heap footprint, plus the event counters when compiled with
+    // PATMEMORY_STATS. Values' own heap allocations (e.g. std::string) are
+    // not counted. bytes_keys is 0 for inline keys: they are in bytes_slots.
+    MemoryStats stats() const {
+        MemoryStats s;
+        s.entries = count;
+        s.max_entries = capacity;
+        s.evictions = evicted;
+        s.slots = table->slot_count();
+        s.load_factor = load_factor();
+        for (const Table* t : {table.get(), old.get(), spare.get()}) {
+            if (t) {
+                s.bytes_ctrl += t->ctrl.bytes() + t->referenced.bytes();
+                s.bytes_slots += t->slots.bytes() + sizeof(Table);
+            }
+        }
+        for (const auto &t : retired)
+            s.bytes_retired += t->ctrl.bytes() + t->referenced.bytes() + t->slots.bytes() + sizeof(Table);
+        s.bytes_retired += retired.capacity() * sizeof(retired[0]);
+        s.bytes_keys = key_bytes();
+        s.bytes_total = sizeof(*this) + s.bytes_ctrl + s.bytes_slots + s.bytes_keys + s.bytes_retired +
+                        cache_counters.bytes();
+        counters.add_to(s);
+        s.misses = s.lookups - s.hits;
+        cache_counters.add_to(s);
+        return s;
+    }
+};
+
+template<typename Value, typename Hasher = PatternKeyHash, typename Alloc = std::allocator<uint8_t>>
+using Memory = BasicMemory<std::string, Value, Hasher, Alloc>;
+
+// How a key set would sit in a Memory table using `Hasher`: full-hash
+// collisions, and the probe lengths and clusters of a table sized like
+// Memory's at its default load, from the table's own geometry.
+struct KeyDistribution {
+    size_t keys = 0;
+    size_t distinct_hashes = 0;
+    double collision_rate = 0;      // fraction of keys whose hash an earlier key already had
+    size_t groups = 0;
+    double mean_probe = 0;          // groups visited per lookup, averaged over keys
+    size_t max_probe = 0;
+    size_t longest_cluster = 0;     // most consecutive full groups
+};
+
+template<typename Hasher = PatternKeyHash, typename Keys>
+KeyDistribution analyze_key_distribution(const Keys &keys, Hasher hasher = Hasher()) {
+    using Table = Memory<char, Hasher>;
+    constexpr size_t kGroup = Table::kGroupSlots;
+    KeyDistribution d;
+    std::vector<uint64_t> hashes;
+    for (const auto &key : keys)
+        hashes.push_back(hasher(std::string_view(key)));
+    d.keys = hashes.size();
+    if (d.keys == 0)
+        return d;
+    d.distinct_hashes = std::unordered_set<uint64_t>(hashes.begin(), hashes.end()).size();
+    d.collision_rate = static_cast<double>(d.keys - d.distinct_hashes) / static_cast<double>(d.keys);
+
+    size_t groups = Table::groups_for(d.keys);
+    d.groups = groups;
+    std::vector<uint8_t> fill(groups, 0);
+    size_t total_probe = 0;
+    for (uint64_t hash : hashes) {
+        size_t group = Table::home_group(hash, groups);
+        size_t probe = 1;
+        while (fill[group] == kGroup) {
+            group = (group + 1) & (groups - 1);
+            ++probe;
+        }
+        ++fill[group];
+        total_probe += probe;
+        d.max_probe = std::max(d.max_probe, probe);
+    }
+    d.mean_probe = static_cast<double>(total_probe) / static_cast<double>(d.keys);
+
+    // Runs of full groups, walking twice round so a run may wrap.
+    size_t run = 0;
+    for (size_t i = 0; i < 2 * groups && run < groups; ++i) {
+        run = fill[i & (groups - 1)] == kGroup ? run + 1 : 0;
+        d.longest_cluster = std::max(d.longest_cluster, run);
+    }
+    return d;
+}
+
+// Point-in-time snapshot handle from Memory::view() or MemoryMT::view():
+// exactly the entries of that moment, while writers carry on. Taking a view
+// copies nothing. It keeps, per array of the table, a copy that fills in
+// segments of 64 groups. A writer copies a group just before it first changes
+// it, and a scan copies the segments no writer touched as it reaches them.
+// A write therefore pays one group copy the first time it touches a group
+// after a view, no lock is held across a scan, and a view dropped early never
+// copies the rest. A view may outlive its table (the table then copies what
+// is left when it is destroyed). Values must be copy-assignable.
+template<typename Key, typename Value, typename Hasher = MemoryDefaultHash<Key>,
+         typename Alloc = std::allocator<uint8_t>>
+class BasicMemoryView {
+private:
+    using Source = BasicMemory<Key, Value, Hasher, Alloc>;
+    using Frozen = typename Source::Frozen;
+    friend Source;
+
+    std::vector<std::shared_ptr<Frozen>> parts;      // one per array the table had
+    std::vector<std::shared_ptr<const char[]>> keys; // arena chunks the string keys point into
+    size_t count = 0;
+
+    void release() {
+        for (const auto &part : parts)
+            part->abandon();
+        parts.clear();
+        keys.clear();
+        count = 0;
+    }
+
+public:
+    using KeyRef = typename Source::KeyRef;
+
+    BasicMemoryView() = default;
+    BasicMemoryView(BasicMemoryView &&other) noexcept
+        : parts(std::move(other.parts)), keys(std::move(other.keys)), count(std::exchange(other.count, 0)) {}
+    BasicMemoryView &operator=(BasicMemoryView &&other) noexcept {
+        if (this != &other) {
+            release();
+            parts = std::move(other.parts);
+            keys = std::move(other.keys);
+            count = std::exchange(other.count, 0);
+        }
+        return *this;
+    }
+    ~BasicMemoryView() { release(); }
+
+    size_t size() const { return count; }
+
+    // Calls fn(key, value) for every entry, in no particular order.
+    template<typename Fn>
+    void for_each(Fn &&fn) const {
+        for (const auto &part : parts)
+            for (size_t s = 0; s < part->segment_count(); ++s)
+                part->visit(s, fn);
+    }
+
+    // for_each() with the segments handed out to the pool's threads and the
+    // caller, one at a time, so fn runs concurrently. fn is called as
+    // fn(key, value), or as fn(worker, key, value) with worker < pool.size() + 1
+    // for per-thread accumulators that need no synchronisation.
+    template<typename Fn>
+    void parallel_for_each(Fn &&fn, ThreadPool &pool = ThreadPool::shared()) const {
+        std::vector<std::pair<Frozen*, size_t>> segments;
+        for (const auto &part : parts)
+            for (size_t s = 0; s < part->segment_count(); ++s)
+                segments.emplace_back(part.get(), s);
+        std::atomic<size_t> next(0);
+        pool.parallel_for(std::min(pool.size() + 1, segments.size()), [&](size_t worker) {
+            auto visit = [&](KeyRef key, const Value &value) {
+                if constexpr (std::is_invocable_v<Fn &, size_t, KeyRef, const Value &>)
+                    fn(worker, key, value);
+                else
+                    fn(key, value);
+            };
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < segments.size();)
+                segments[i].first->visit(segments[i].second, visit);
+        });
+    }
 };
 
+template<typename Value, typename Hasher = PatternKeyHash, typename Alloc = std::allocator<uint8_t>>
+using MemoryView = BasicMemoryView<std::string, Value, Hasher, Alloc>;
+
 #endif // PATMEMORY_H
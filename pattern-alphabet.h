@@ -0,0 +1,120 @@
+#ifndef PATTERN_ALPHABET_H
+#define PATTERN_ALPHABET_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+#include "pattern.h"
+
+// The pattern hash over an arbitrary alphabet: H(w) = sum (i+1) * Len(w_i)
+// mod 2^64, where Len comes from a 256-entry table fixed at compile time.
+//
+//     constexpr PatternLenTable kWithX = kPaperLenTable.with('x', 3);
+//     using XHash = PatternAlphabetHash<kWithX>;
+//     static_assert(XHash::hash("*&1x") == ...);   // folds to a constant
+//
+// The table is a template argument, so each alphabet gets its own kernel
+// with the table in read-only data. At run time every byte costs one table
+// load and two adds, with no branch on the symbol. Under the paper's own
+// table the hasher forwards to hash_function_64 and its SIMD kernels.
+
+// Len('*') in the paper is infinite; modulo 2^64 it is the all-ones word.
+constexpr uint64_t kPatternLenInfinite = UINT64_MAX;
+
+struct PatternSymbolLen {
+    unsigned char symbol;
+    uint64_t len;
+};
+
+// Structural, so a table can be a template argument.
+struct PatternLenTable {
+    uint64_t len[256];
+
+    constexpr uint64_t operator[](unsigned char c) const { return len[c]; }
+
+    // Copy with one symbol's Len replaced.
+    constexpr PatternLenTable with(unsigned char symbol, uint64_t value) const {
+        PatternLenTable t = *this;
+        t.len[symbol] = value;
+        return t;
+    }
+
+    constexpr bool operator==(const PatternLenTable &) const = default;
+};
+
+// Every byte gets `other`, then each listed symbol its own Len.
+constexpr PatternLenTable pattern_len_table(std::initializer_list<PatternSymbolLen> symbols,
+                                            uint64_t other = 1) {
+    PatternLenTable t{};
+    for (uint64_t &len : t.len)
+        len = other;
+    for (const PatternSymbolLen &s : symbols)
+        t.len[s.symbol] = s.len;
+    return t;
+}
+
+// '1' -> 1, '&' -> 2, '*' -> infinite, everything else -> 1 (pattern-learning.tex, section 2).
+inline constexpr PatternLenTable kPaperLenTable =
+    pattern_len_table({{'1', 1}, {'&', 2}, {'*', kPatternLenInfinite}});
+
+template<PatternLenTable Table = kPaperLenTable>
+struct PatternAlphabetHash {
+    static constexpr PatternLenTable table = Table;
+    static constexpr bool kPaper = Table == kPaperLenTable;
+
+    // Hash and LenSum of str[0, len). Runs four quarters of the input side
+    // by side, each as a running sum (H = (n+1) * LenSum - sum of prefix
+    // sums, so no multiply per byte), then joins them as PatternSegments.
+    static PatternSegment segment(const char* str, size_t len) {
+        constexpr size_t kStreams = 4;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(str);
+        size_t quarter = len / kStreams;
+        uint64_t run[kStreams] = {}, acc[kStreams] = {};
+        const unsigned char* q[kStreams];
+        for (size_t s = 0; s < kStreams; ++s)
+            q[s] = p + s * quarter;
+        for (size_t i = 0; i < quarter; ++i) {
+            for (size_t s = 0; s < kStreams; ++s) {
+                run[s] += table.len[q[s][i]];
+                acc[s] += run[s];
+            }
+        }
+        for (size_t i = kStreams * quarter; i < len; ++i) { // tail joins the last quarter
+            run[kStreams - 1] += table.len[p[i]];
+            acc[kStreams - 1] += run[kStreams - 1];
+        }
+        PatternSegment out;
+        for (size_t s = 0; s < kStreams; ++s) {
+            uint64_t n = s + 1 < kStreams ? quarter : len - (kStreams - 1) * quarter;
+            out.append({(n + 1) * run[s] - acc[s], run[s], n});
+        }
+        return out;
+    }
+
+    static constexpr uint64_t hash(const char* str, size_t len) {
+        if consteval {
+            uint64_t h = 0;
+            for (size_t i = 0; i < len; ++i)
+                h += (i + 1) * table.len[static_cast<unsigned char>(str[i])];
+            return h;
+        } else {
+            if constexpr (kPaper)
+                return hash_function_64(str, len);
+            else
+                return segment(str, len).hash;
+        }
+    }
+
+    static constexpr uint64_t hash(std::string_view key) { return hash(key.data(), key.size()); }
+    static constexpr uint32_t hash32(std::string_view key) { return static_cast<uint32_t>(hash(key)); }
+
+    uint64_t operator()(std::string_view key) const { return hash(key); }
+
+    // Batch form for get_many/put_many; only the paper table has vector kernels.
+    void hash_many(std::span<const std::string_view> keys, uint64_t* out) const requires kPaper {
+        ::hash_many(keys, out);
+    }
+};
+
+#endif // PATTERN_ALPHABET_H
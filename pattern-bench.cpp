@@ -0,0 +1,622 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <thread>
+#include <barrier>
+#include <atomic>
+#include <unordered_map>
+#include <list>
+
+#include "pattern.h"
+#include "patmemory.h"
+#include "patmemory-mt.h"
+
+// Benchmark suite for the hash kernels and the Memory tables.
+//
+//   ./pattern-bench [--quick] [--threads N] [--filter TEXT] [--seed N] [--repeat N]
+//                   [--json FILE] [--baseline FILE] [--tolerance FRACTION]
+//
+// Every benchmark runs a warmup pass and then a timed pass on each thread.
+// Both passes are split into batches of ops, and the clock is read only
+// between batches. A batch is large enough that reading the clock costs well
+// under 1% of it. The latency percentiles are over per-op times averaged
+// within a batch, so they are smoothed over `batch` ops. Throughput is the
+// total op count over the wall time from the common start to the last thread
+// finishing. Each benchmark is repeated (--repeat, default 5, 3 with --quick)
+// and the repetition with the median throughput is reported. Inputs and per-thread RNGs derive from --seed, so two runs do the
+// same work. --json writes one result per line. --baseline reads such a file
+// back, prints the throughput change per benchmark and exits with status 1 if
+// any benchmark is slower by more than --tolerance (default 0.10).
+//
+// Build without PATMEMORY_STATS. The counters would be measured too.
+
+struct BenchConfig {
+    bool quick = false;
+    size_t threads = 0;         // highest thread count for the MemoryMT runs
+    std::string filter;         // run only benchmarks whose name contains this
+    uint64_t seed = 42;
+    size_t repeat = 0;          // 0: 5, or 3 with --quick
+    std::string json_path;
+    std::string baseline_path;
+    double tolerance = 0.10;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t threads = 1;
+    uint64_t ops = 0;
+    double seconds = 0;
+    double mops = 0;
+    double p50_ns = 0;
+    double p99_ns = 0;
+    double p999_ns = 0;
+};
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t rank = static_cast<size_t>(p * static_cast<double>(sorted.size()) + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static std::atomic<uint64_t> bench_sink{0}; // results land here so no op is optimised away
+
+// Runs op(thread, rng, count) on `threads` threads. Each call performs
+// `count` operations and returns a checksum of them. Every thread does
+// `batches` timed batches of `batch` ops after batches / 10 warmup batches.
+template<typename Op>
+BenchResult run_once(const std::string &name, const BenchConfig &cfg, size_t threads, size_t batch,
+                     size_t batches, Op &op) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<std::vector<double>> samples(threads);
+    std::vector<Clock::time_point> starts(threads), ends(threads);
+    std::barrier sync(static_cast<std::ptrdiff_t>(threads));
+    auto worker = [&](size_t t) {
+        std::mt19937_64 rng(cfg.seed * 0x9E3779B97F4A7C15ULL + t + 1); // per-thread RNG
+        uint64_t sink = 0;
+        for (size_t i = 0; i < std::max<size_t>(batches / 10, 1); ++i)
+            sink += op(t, rng, batch);
+        samples[t].reserve(batches);
+        sync.arrive_and_wait();
+        starts[t] = Clock::now();
+        Clock::time_point last = starts[t];
+        for (size_t i = 0; i < batches; ++i) {
+            sink += op(t, rng, batch);
+            Clock::time_point now = Clock::now();
+            samples[t].push_back(std::chrono::duration<double, std::nano>(now - last).count() /
+                                 static_cast<double>(batch));
+            last = now;
+        }
+        ends[t] = last;
+        bench_sink.fetch_add(sink, std::memory_order_relaxed);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; ++t)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : pool)
+        th.join();
+
+    std::vector<double> all;
+    for (auto &s : samples)
+        all.insert(all.end(), s.begin(), s.end());
+    std::sort(all.begin(), all.end());
+    BenchResult r;
+    r.name = name;
+    r.threads = threads;
+    r.ops = static_cast<uint64_t>(threads * batches * batch);
+    r.seconds = std::chrono::duration<double>(*std::max_element(ends.begin(), ends.end()) -
+                                              *std::min_element(starts.begin(), starts.end())).count();
+    r.mops = static_cast<double>(r.ops) / r.seconds / 1e6;
+    r.p50_ns = percentile(all, 0.50);
+    r.p99_ns = percentile(all, 0.99);
+    r.p999_ns = percentile(all, 0.999);
+    return r;
+}
+
+// run_once() cfg.repeat times, calling reset() untimed before each; the
+// repetition with the median throughput.
+template<typename Op, typename Reset>
+BenchResult run_bench(const std::string &name, const BenchConfig &cfg, size_t threads, size_t batch,
+                      size_t batches, Op &&op, Reset &&reset) {
+    std::vector<BenchResult> runs;
+    for (size_t i = 0; i < cfg.repeat; ++i) {
+        reset();
+        runs.push_back(run_once(name, cfg, threads, batch, batches, op));
+    }
+    std::sort(runs.begin(), runs.end(), [](const BenchResult &a, const BenchResult &b) { return a.mops < b.mops; });
+    return runs[runs.size() / 2];
+}
+
+template<typename Op>
+BenchResult run_bench(const std::string &name, const BenchConfig &cfg, size_t threads, size_t batch,
+                      size_t batches, Op &&op) {
+    return run_bench(name, cfg, threads, batch, batches, op, [] {});
+}
+
+static std::string result_json(const BenchResult &r) {
+    std::ostringstream out;
+    out << std::setprecision(6) << "{\"name\": \"" << r.name << "\", \"threads\": " << r.threads
+        << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds << ", \"mops\": " << r.mops
+        << ", \"p50_ns\": " << r.p50_ns << ", \"p99_ns\": " << r.p99_ns << ", \"p999_ns\": " << r.p999_ns
+        << "}";
+    return out.str();
+}
+
+static std::string baseline_key(const std::string &name, size_t threads) {
+    return name + "@" + std::to_string(threads);
+}
+
+// Reads name@threads -> mops from a file written by --json (one result per line).
+static std::unordered_map<std::string, double> read_baseline(const std::string &path) {
+    std::unordered_map<std::string, double> base;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t name = line.find("\"name\": \"");
+        size_t threads = line.find("\"threads\": ");
+        size_t mops = line.find("\"mops\": ");
+        if (name == std::string::npos || threads == std::string::npos || mops == std::string::npos)
+            continue;
+        name += 9;
+        base[baseline_key(line.substr(name, line.find('"', name) - name),
+                          std::strtoull(line.c_str() + threads + 11, nullptr, 10))] =
+            std::strtod(line.c_str() + mops + 8, nullptr);
+    }
+    return base;
+}
+
+// Random keys of 8-23 alphanumeric bytes.
+static std::vector<std::string> make_keys(size_t count, uint64_t seed) {
+    static const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::mt19937_64 gen(seed);
+    std::vector<std::string> keys(count);
+    for (std::string &key : keys) {
+        key.resize(8 + gen() % 16);
+        for (char &c : key)
+            c = charset[gen() % (sizeof(charset) - 1)];
+    }
+    return keys;
+}
+
+static std::string make_text(size_t length, uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    std::string text(length, ' ');
+    for (char &c : text)
+        c = static_cast<char>(33 + gen() % 94);
+    return text;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << arg << " needs a value" << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--quick") cfg.quick = true;
+        else if (arg == "--threads") cfg.threads = std::strtoull(next(), nullptr, 10);
+        else if (arg == "--filter") cfg.filter = next();
+        else if (arg == "--seed") cfg.seed = std::strtoull(next(), nullptr, 10);
+        else if (arg == "--repeat") cfg.repeat = std::strtoull(next(), nullptr, 10);
+        else if (arg == "--json") cfg.json_path = next();
+        else if (arg == "--baseline") cfg.baseline_path = next();
+        else if (arg == "--tolerance") cfg.tolerance = std::strtod(next(), nullptr);
+        else {
+            std::cerr << "usage: " << argv[0] << " [--quick] [--threads N] [--filter TEXT] [--seed N] [--repeat N]"
+                      << " [--json FILE] [--baseline FILE] [--tolerance FRACTION]" << std::endl;
+            return 2;
+        }
+    }
+    if (cfg.threads == 0)
+        cfg.threads = std::max(1u, std::thread::hardware_concurrency());
+    if (cfg.repeat == 0)
+        cfg.repeat = cfg.quick ? 3 : 5;
+    const size_t scale = cfg.quick ? 10 : 1;   // --quick divides the work by ten
+    const size_t tableKeys = cfg.quick ? 100000 : 1000000;
+
+    std::vector<BenchResult> results;
+    auto wanted = [&](const std::string &name) {
+        return cfg.filter.empty() || name.find(cfg.filter) != std::string::npos;
+    };
+    auto record = [&](BenchResult r) {
+        std::cout << std::left << std::setw(28) << r.name << std::right << std::setw(3) << r.threads << "T "
+                  << std::fixed << std::setprecision(2) << std::setw(10) << r.mops << " Mops/s   p50 "
+                  << std::setw(9) << r.p50_ns << " ns   p99 " << std::setw(9) << r.p99_ns << " ns   p999 "
+                  << std::setw(9) << r.p999_ns << " ns" << std::defaultfloat << std::endl;
+        results.push_back(std::move(r));
+    };
+
+    std::cout << "kernel " << pattern_kernel_name(pattern_active_kernel()) << ", seed " << cfg.seed
+              << ", up to " << cfg.threads << " threads" << (cfg.quick ? ", quick" : "") << std::endl;
+
+    // 1. Hash kernels: one input, hashed back to back.
+    for (size_t len : {size_t(16), size_t(100), size_t(4096), size_t(1) << 20}) {
+        std::string name = "hash64/" + std::to_string(len) + "B";
+        if (!wanted(name))
+            continue;
+        std::string text = make_text(len, cfg.seed);
+        size_t batch = std::max<size_t>(1, (size_t(1) << 16) / len);
+        size_t batches = std::max<size_t>(20, (size_t(20000) / scale) * 100 / std::max<size_t>(len, 100));
+        record(run_bench(name, cfg, 1, batch, batches, [&](size_t, std::mt19937_64 &, size_t count) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < count; ++i)
+                sum += hash_function_64(text.data(), len - (i & 1)); // varies so calls are not merged
+            return sum;
+        }));
+    }
+    // Many short keys: one call per key against hash_many over the batch.
+    if (wanted("hash64/keys-8-64B") || wanted("hash_many/keys-8-64B")) {
+        std::mt19937_64 gen(cfg.seed);
+        std::vector<std::string> owned(4096);
+        std::vector<std::string_view> views(owned.size());
+        for (size_t i = 0; i < owned.size(); ++i) {
+            owned[i] = make_text(8 + gen() % 57, gen());
+            views[i] = owned[i];
+        }
+        std::vector<uint64_t> hashes(views.size());
+        if (wanted("hash64/keys-8-64B"))
+            record(run_bench("hash64/keys-8-64B", cfg, 1, views.size(), 2000 / scale,
+                             [&](size_t, std::mt19937_64 &, size_t count) {
+                uint64_t sum = 0;
+                for (size_t i = 0; i < count; ++i)
+                    sum += hash_function_64(views[i].data(), views[i].size());
+                return sum;
+            }));
+        if (wanted("hash_many/keys-8-64B"))
+            record(run_bench("hash_many/keys-8-64B", cfg, 1, views.size(), 2000 / scale,
+                             [&](size_t, std::mt19937_64 &, size_t count) {
+                hash_many(std::span<const std::string_view>(views.data(), count), hashes.data());
+                return hashes[count - 1];
+            }));
+    }
+    if (wanted("fastkeyhash/16B")) {
+        std::vector<std::string> keys = make_keys(4096, cfg.seed);
+        FastKeyHash hasher;
+        record(run_bench("fastkeyhash/16B", cfg, 1, 4096, 2000 / scale,
+                         [&](size_t, std::mt19937_64 &, size_t count) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < count; ++i)
+                sum += hasher(keys[i & 4095]);
+            return sum;
+        }));
+    }
+
+    // 2. Single-threaded tables against std::unordered_map, on the same keys.
+    std::vector<std::string> keys = make_keys(tableKeys, cfg.seed);
+    std::vector<std::string> missing = make_keys(tableKeys, cfg.seed + 1);
+    const size_t lookupBatch = 256;
+    const size_t lookupBatches = 4000 / scale;
+    const size_t insertBatches = tableKeys / lookupBatch;
+
+    if (wanted("memory/") || wanted("unordered_map/")) {
+        // Inserts fill a fresh, initially small table per repetition, so
+        // growth is part of the cost; warmup and timed batches share it.
+        size_t next = 0;
+        if (wanted("memory/insert")) {
+            std::unique_ptr<Memory<int, FastKeyHash>> fresh;
+            record(run_bench("memory/insert", cfg, 1, lookupBatch, insertBatches - insertBatches / 10 - 1,
+                             [&](size_t, std::mt19937_64 &, size_t count) {
+                for (size_t i = 0; i < count; ++i, ++next)
+                    fresh->put(keys[next], static_cast<int>(next));
+                return uint64_t(fresh->size());
+            }, [&] {
+                fresh = std::make_unique<Memory<int, FastKeyHash>>(1024, MemoryGrowth::Double);
+                next = 0;
+            }));
+        }
+        if (wanted("unordered_map/insert")) {
+            std::unique_ptr<std::unordered_map<std::string, int>> fresh;
+            record(run_bench("unordered_map/insert", cfg, 1, lookupBatch, insertBatches - insertBatches / 10 - 1,
+                             [&](size_t, std::mt19937_64 &, size_t count) {
+                for (size_t i = 0; i < count; ++i, ++next)
+                    fresh->emplace(keys[next], static_cast<int>(next));
+                return uint64_t(fresh->size());
+            }, [&] {
+                fresh = std::make_unique<std::unordered_map<std::string, int>>();
+                next = 0;
+            }));
+        }
+
+        Memory<int, FastKeyHash> mem(keys.size());
+        std::unordered_map<std::string, int> map;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            mem.put(keys[i], static_cast<int>(i));
+            map.emplace(keys[i], static_cast<int>(i));
+        }
+
+        auto lookups = [&](const char* name, auto &&get, const std::vector<std::string> &from) {
+            if (wanted(name))
+                record(run_bench(name, cfg, 1, lookupBatch, lookupBatches,
+                                 [&](size_t, std::mt19937_64 &rng, size_t count) {
+                    uint64_t hits = 0;
+                    for (size_t i = 0; i < count; ++i)
+                        hits += get(from[rng() % from.size()]);
+                    return hits;
+                }));
+        };
+        lookups("memory/get-hit", [&](const std::string &k) { int v; return mem.get(k, v) ? v : 0; }, keys);
+        lookups("memory/get-miss", [&](const std::string &k) { int v; return mem.get(k, v) ? 1 : 0; }, missing);
+        lookups("unordered_map/get-hit", [&](const std::string &k) {
+            auto it = map.find(k);
+            return it != map.end() ? it->second : 0;
+        }, keys);
+        lookups("unordered_map/get-miss", [&](const std::string &k) { return map.count(k) ? 1 : 0; }, missing);
+        lookups("memory/put-update", [&](const std::string &k) { return mem.put(k, 7) ? 1 : 0; }, keys);
+        lookups("unordered_map/put-update", [&](const std::string &k) { map[k] = 7; return 1; }, keys);
+
+        if (wanted("memory/get_many")) {
+            std::vector<std::string_view> views(lookupBatch);
+            std::vector<int> values(lookupBatch);
+            record(run_bench("memory/get_many", cfg, 1, lookupBatch, lookupBatches,
+                             [&](size_t, std::mt19937_64 &rng, size_t count) {
+                for (size_t i = 0; i < count; ++i)
+                    views[i] = keys[rng() % keys.size()];
+                return uint64_t(mem.get_many(std::span<const std::string_view>(views.data(), count),
+                                             std::span<int>(values.data(), count)));
+            }));
+        }
+    }
+
+    // Integer keys stored inline, against the same IDs spelled as strings.
+    if (wanted("memory/u64-") || wanted("memory/u64str-")) {
+        std::vector<uint64_t> ids(tableKeys);
+        std::vector<std::string> idStrings(tableKeys);
+        std::mt19937_64 idGen(cfg.seed);
+        for (size_t i = 0; i < tableKeys; ++i) {
+            ids[i] = idGen();
+            idStrings[i] = std::to_string(ids[i]);
+        }
+        BasicMemory<uint64_t, int> byId(tableKeys);
+        Memory<int, FastKeyHash> byString(tableKeys);
+        for (size_t i = 0; i < tableKeys; ++i) {
+            byId.put(ids[i], static_cast<int>(i));
+            byString.put(idStrings[i], static_cast<int>(i));
+        }
+        auto idLookups = [&](const char* name, auto &&get) {
+            if (wanted(name))
+                record(run_bench(name, cfg, 1, lookupBatch, lookupBatches,
+                                 [&](size_t, std::mt19937_64 &rng, size_t count) {
+                    uint64_t hits = 0;
+                    for (size_t i = 0; i < count; ++i)
+                        hits += get(ids[rng() % ids.size()]);
+                    return hits;
+                }));
+        };
+        idLookups("memory/u64-get-hit", [&](uint64_t id) { int v; return byId.get(id, v) ? 1 : 0; });
+        idLookups("memory/u64str-get-hit", [&](uint64_t id) { int v; return byString.get(std::to_string(id), v) ? 1 : 0; });
+    }
+
+    // Slot storage of a table far past the TLB's reach: building one (with the
+    // old serially constructed std::vector layout as the baseline) and random
+    // hits, on the default allocator and on 2 MB pages.
+    if (wanted("memory/big-")) {
+        using StdTable = BasicMemory<uint64_t, uint64_t, FixedKeyHash>;
+        using HugeTable = BasicMemory<uint64_t, uint64_t, FixedKeyHash, HugePageAllocator<uint8_t>>;
+        struct VectorSlot {
+            uint64_t key, value;
+            VectorSlot() : key(), value() {}
+        };
+        const size_t bigKeys = cfg.quick ? 2000000 : 16000000;
+        const size_t bigSlots = StdTable(bigKeys).slot_count();
+        const size_t builds = cfg.quick ? 3 : 10;
+        auto construct = [&](const char* name, auto &&build) {
+            if (wanted(name))
+                record(run_bench(name, cfg, 1, 1, builds, [&](size_t, std::mt19937_64 &, size_t count) {
+                    uint64_t slots = 0;
+                    for (size_t i = 0; i < count; ++i)
+                        slots += build();
+                    return slots;
+                }));
+        };
+        construct("memory/big-construct-vector", [&] {
+            std::vector<uint8_t> ctrl(bigSlots, 0x80);
+            std::vector<VectorSlot> slots(bigSlots);
+            return uint64_t(ctrl.size() + slots.size());
+        });
+        construct("memory/big-construct-std", [&] { return uint64_t(StdTable(bigKeys).slot_count()); });
+        construct("memory/big-construct-hugepage", [&] { return uint64_t(HugeTable(bigKeys).slot_count()); });
+
+        // Keys are i times an odd constant, so a lookup needs no key array of its own.
+        constexpr uint64_t kSpread = 0x9E3779B97F4A7C15ULL;
+        auto lookups = [&](const char* name, auto &table) {
+            if (!wanted(name))
+                return;
+            for (uint64_t i = 0; i < bigKeys; ++i)
+                table.put(i * kSpread, i);
+            record(run_bench(name, cfg, 1, lookupBatch, lookupBatches, [&](size_t, std::mt19937_64 &rng, size_t count) {
+                uint64_t sum = 0, v;
+                for (size_t i = 0; i < count; ++i)
+                    sum += table.get((rng() % bigKeys) * kSpread, v) ? v : 0;
+                return sum;
+            }));
+        };
+        {
+            StdTable table(bigKeys);
+            lookups("memory/big-get-std", table);
+        }
+        {
+            HugeTable table(bigKeys);
+            lookups("memory/big-get-hugepage", table);
+        }
+    }
+
+    // 3. MemoryMT with 1, 2, 4 ... threads.
+    if (wanted("memorymt/")) {
+        MemoryMT<int, FastKeyHash> mt(tableKeys, 64);
+        for (size_t i = 0; i < keys.size(); ++i)
+            mt.put(keys[i], static_cast<int>(i));
+        std::vector<size_t> threadCounts;
+        for (size_t n = 1; n < cfg.threads; n *= 2)
+            threadCounts.push_back(n);
+        threadCounts.push_back(cfg.threads);
+        for (size_t threads : threadCounts) {
+            if (wanted("memorymt/get"))
+                record(run_bench("memorymt/get", cfg, threads, lookupBatch, lookupBatches,
+                                 [&](size_t, std::mt19937_64 &rng, size_t count) {
+                    uint64_t hits = 0;
+                    int v;
+                    for (size_t i = 0; i < count; ++i)
+                        hits += mt.get(keys[rng() % keys.size()], v);
+                    return hits;
+                }));
+            if (wanted("memorymt/mixed-20put"))
+                record(run_bench("memorymt/mixed-20put", cfg, threads, lookupBatch, lookupBatches,
+                                 [&](size_t, std::mt19937_64 &rng, size_t count) {
+                    uint64_t hits = 0;
+                    int v;
+                    for (size_t i = 0; i < count; ++i) {
+                        uint64_t r = rng();
+                        const std::string &key = keys[(r >> 8) % keys.size()];
+                        hits += r % 5 == 0 ? mt.put(key, static_cast<int>(i)) : mt.get(key, v);
+                    }
+                    return hits;
+                }));
+            // Updates with and without a view held: the first write to each
+            // group after a view copies that group into it.
+            MemoryView<int, FastKeyHash> held;
+            auto updates = [&](size_t, std::mt19937_64 &rng, size_t count) {
+                uint64_t stored = 0;
+                for (size_t i = 0; i < count; ++i)
+                    stored += mt.put(keys[rng() % keys.size()], static_cast<int>(i));
+                return stored;
+            };
+            if (wanted("memorymt/put-update"))
+                record(run_bench("memorymt/put-update", cfg, threads, lookupBatch, lookupBatches, updates));
+            if (wanted("memorymt/put-update-viewed"))
+                record(run_bench("memorymt/put-update-viewed", cfg, threads, lookupBatch, lookupBatches, updates,
+                                 [&] { held = mt.view(); }));
+            // Inserts of new integer keys into a table that starts at 1024
+            // entries and doubles; p999 shows what each resize costs a put.
+            if (wanted("memorymt/grow")) {
+                std::unique_ptr<BasicMemoryMT<uint64_t, int>> grow;
+                std::vector<uint64_t> next(threads);
+                record(run_bench("memorymt/grow", cfg, threads, lookupBatch, lookupBatches,
+                                 [&](size_t t, std::mt19937_64 &, size_t count) {
+                    uint64_t added = 0;
+                    for (size_t i = 0; i < count; ++i)
+                        added += grow->put(next[t]++ * threads + t, static_cast<int>(i));
+                    return added;
+                }, [&] {
+                    grow = std::make_unique<BasicMemoryMT<uint64_t, int>>(1024, 16, MemoryGrowth::Double);
+                    std::fill(next.begin(), next.end(), 0);
+                }));
+            }
+        }
+    }
+
+    // 4. Caches holding an eighth of the keys, under skewed reads (the
+    // smaller of two uniform picks); a miss puts the key. CLOCK eviction in
+    // the table against a std::list LRU wrapped around an unordered_map.
+    if (wanted("cache/")) {
+        const size_t cacheCap = keys.size() / 8;
+        auto skewed = [&](std::mt19937_64 &rng) -> const std::string & {
+            return keys[std::min(rng() % keys.size(), rng() % keys.size())];
+        };
+        if (wanted("cache/clock")) {
+            Memory<int, FastKeyHash> cache(cacheCap, MemoryGrowth::Evict);
+            record(run_bench("cache/clock", cfg, 1, lookupBatch, lookupBatches,
+                             [&](size_t, std::mt19937_64 &rng, size_t count) {
+                uint64_t hits = 0;
+                int v;
+                for (size_t i = 0; i < count; ++i) {
+                    const std::string &key = skewed(rng);
+                    if (cache.get(key, v))
+                        ++hits;
+                    else
+                        cache.put(key, static_cast<int>(i));
+                }
+                return hits;
+            }));
+        }
+        if (wanted("cache/list-lru")) {
+            using Order = std::list<std::pair<std::string, int>>;
+            Order order;
+            std::unordered_map<std::string_view, Order::iterator> index;
+            record(run_bench("cache/list-lru", cfg, 1, lookupBatch, lookupBatches,
+                             [&](size_t, std::mt19937_64 &rng, size_t count) {
+                uint64_t hits = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    const std::string &key = skewed(rng);
+                    auto it = index.find(key);
+                    if (it != index.end()) {
+                        order.splice(order.begin(), order, it->second);
+                        ++hits;
+                        continue;
+                    }
+                    if (order.size() == cacheCap) {
+                        index.erase(order.back().first);
+                        order.pop_back();
+                    }
+                    order.emplace_front(key, static_cast<int>(i));
+                    index.emplace(order.front().first, order.begin());
+                }
+                return hits;
+            }));
+        }
+        if (wanted("cache/memorymt-clock")) {
+            MemoryMT<int, FastKeyHash> cache(cacheCap, 64, MemoryGrowth::Evict);
+            std::vector<size_t> threadCounts;
+            for (size_t n = 1; n < cfg.threads; n *= 2)
+                threadCounts.push_back(n);
+            threadCounts.push_back(cfg.threads);
+            for (size_t threads : threadCounts)
+                record(run_bench("cache/memorymt-clock", cfg, threads, lookupBatch, lookupBatches,
+                                 [&](size_t, std::mt19937_64 &rng, size_t count) {
+                    uint64_t hits = 0;
+                    int v;
+                    for (size_t i = 0; i < count; ++i) {
+                        const std::string &key = skewed(rng);
+                        if (cache.get(key, v))
+                            ++hits;
+                        else
+                            cache.put(key, static_cast<int>(i));
+                    }
+                    return hits;
+                }));
+        }
+    }
+
+    // Results, then the comparison against a stored run.
+    if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        out << "{\"seed\": " << cfg.seed << ", \"kernel\": \"" << pattern_kernel_name(pattern_active_kernel())
+            << "\", \"quick\": " << (cfg.quick ? "true" : "false") << ", \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+            out << result_json(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+        out << "]}\n";
+        std::cout << "Wrote " << results.size() << " results to " << cfg.json_path << std::endl;
+    }
+    int status = 0;
+    if (!cfg.baseline_path.empty()) {
+        auto base = read_baseline(cfg.baseline_path);
+        std::cout << "\nAgainst " << cfg.baseline_path << " (tolerance " << cfg.tolerance * 100 << "%):" << std::endl;
+        for (const BenchResult &r : results) {
+            auto it = base.find(baseline_key(r.name, r.threads));
+            if (it == base.end() || it->second <= 0)
+                continue;
+            double change = r.mops / it->second - 1;
+            bool regressed = change < -cfg.tolerance;
+            status |= regressed;
+            std::cout << std::left << std::setw(28) << r.name << std::right << std::setw(3) << r.threads << "T "
+                      << std::showpos << std::fixed << std::setprecision(1) << change * 100 << "%"
+                      << std::noshowpos << std::defaultfloat << (regressed ? "  REGRESSION" : "") << std::endl;
+        }
+    }
+    return status;
+}
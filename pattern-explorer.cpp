@@ -0,0 +1,123 @@
+#include <cstdint>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+
+#include "pattern.h"
+#include "pattern-explorer.h"
+
+// Single-threaded breadth-first search over the same rules, for comparison.
+std::unordered_map<std::string, uint32_t> naive_reachable(const std::string &start, const ExplorerConfig &cfg) {
+    std::unordered_map<std::string, uint32_t> seen{{start, 0}};
+    std::deque<std::string> queue{start};
+    while (!queue.empty()) {
+        std::string word = queue.front();
+        queue.pop_front();
+        uint32_t depth = seen[word];
+        if (depth == cfg.max_depth)
+            continue;
+        for (const RewriteRule &rule : pattern_paper_rules())
+            for (size_t at = word.find(rule.from); at != std::string::npos; at = word.find(rule.from, at + 1)) {
+                std::string child = word.substr(0, at) + rule.to + word.substr(at + rule.from.size());
+                if (child.size() <= cfg.max_length && seen.emplace(child, depth + 1).second)
+                    queue.push_back(child);
+            }
+    }
+    return seen;
+}
+
+void print_stats(const ExplorerStats &s) {
+    std::cout << s.words << " words in " << s.levels << " levels, " << s.distinct_hashes << " distinct hashes, "
+              << s.hash_collisions << " collisions, " << s.dropped << " dropped, " << s.seconds * 1000 << " ms"
+              << (s.resumed ? " (resumed)" : "") << std::endl;
+    if (!s.checkpoint_error.empty())
+        std::cout << "  checkpoint: " << s.checkpoint_error << std::endl;
+    std::cout << "  per depth:";
+    for (size_t n : s.per_depth)
+        std::cout << " " << n;
+    std::cout << std::endl;
+}
+
+int main() {
+    // 1. Words reachable from "&" in a few rewrites:
+    std::cout << "\n1. Reachable From \"&\":" << std::endl;
+    ExplorerConfig small;
+    small.max_depth = 3;
+    PatternExplorer smallExplorer(pattern_paper_rules(), small);
+    print_stats(smallExplorer.run("&"));
+    smallExplorer.for_each([](std::string_view word, uint32_t depth) {
+        std::cout << "  " << depth << ": " << word << std::endl;
+    });
+
+    // 2. Against a single-threaded search:
+    std::cout << "\n2. Naive Comparison Test:" << std::endl;
+    ExplorerConfig cfg;
+    cfg.max_depth = 7;
+    cfg.max_length = 14;
+    PatternExplorer explorer(pattern_paper_rules(), cfg);
+    ExplorerStats stats = explorer.run("*&1*");
+    print_stats(stats);
+    auto naive = naive_reachable("*&1*", cfg);
+    size_t mismatches = naive.size() != stats.words;
+    for (const auto &[word, depth] : naive) {
+        uint32_t found;
+        mismatches += !explorer.reached(word, found) || found != depth;
+    }
+    std::cout << "Naive search: " << naive.size() << " words, " << mismatches << " mismatches" << std::endl;
+
+    // 3. Thread scaling on a larger bound:
+    std::cout << "\n3. Scaling:" << std::endl;
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        ExplorerConfig big;
+        big.max_depth = 12;
+        big.max_length = 18;
+        big.max_words = size_t(1) << 22;
+        big.threads = threads;
+        std::cout << threads << " threads: ";
+        print_stats(PatternExplorer(pattern_paper_rules(), big).run("*&1*"));
+        if (threads == maxThreads)
+            break;
+    }
+
+    // 4. Bounded memory and checkpoints:
+    std::cout << "\n4. Bounded Memory and Checkpoint Test:" << std::endl;
+    ExplorerConfig bounded = cfg;
+    bounded.max_words = 1000;
+    print_stats(PatternExplorer(pattern_paper_rules(), bounded).run("*&1*"));
+    std::string path = (std::filesystem::temp_directory_path() / "pattern-explorer.ckpt").string();
+    std::filesystem::remove(path);
+    ExplorerConfig first = cfg;
+    first.max_depth = 4;
+    first.checkpoint = path;
+    print_stats(PatternExplorer(pattern_paper_rules(), first).run("*&1*"));
+    ExplorerConfig second = cfg;
+    second.checkpoint = path;
+    ExplorerStats resumed = PatternExplorer(pattern_paper_rules(), second).run("*&1*");
+    print_stats(resumed);
+    std::cout << "Resumed run " << (resumed.words == stats.words && resumed.per_depth == stats.per_depth
+                                        ? "matches" : "DIFFERS FROM")
+              << " the uninterrupted one" << std::endl;
+    // The checkpoint now holds "*&1*"; another start word must not pick it up.
+    ExplorerStats other = PatternExplorer(pattern_paper_rules(), second).run("&1x");
+    ExplorerStats fresh = PatternExplorer(pattern_paper_rules(), cfg).run("&1x");
+    print_stats(other);
+    std::cout << "Other start word " << (!other.resumed && other.words == fresh.words &&
+                                         other.per_depth == fresh.per_depth
+                                             ? "starts fresh" : "WRONGLY RESUMED")
+              << " against the existing checkpoint" << std::endl;
+    std::filesystem::remove(path);
+    // A checkpoint that cannot be written is reported, not silently skipped.
+    ExplorerConfig unwritable = first;
+    unwritable.checkpoint = (std::filesystem::temp_directory_path() / "no-such-dir" / "x.ckpt").string();
+    ExplorerStats failed = PatternExplorer(pattern_paper_rules(), unwritable).run("*&1*");
+    print_stats(failed);
+    std::cout << "Unwritable checkpoint " << (failed.checkpoint_error.empty() ? "NOT REPORTED" : "reported")
+              << std::endl;
+
+    return 0;
+}
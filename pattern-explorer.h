@@ -0,0 +1,295 @@
+#ifndef PATTERN_EXPLORER_H
+#define PATTERN_EXPLORER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "pattern.h"
+#include "patmemory-mt.h"
+#include "patmemory-snapshot.h"
+#include "pattern-threadpool.h"
+
+// One non-deterministic rewrite: any occurrence of `from` may become `to`.
+struct RewriteRule {
+    std::string from;
+    std::string to;
+};
+
+// The rules of pattern-learning.tex, section 2, reading "* + 1" as the factor "*1":
+//     * -> 1,   & -> *1,   *1 -> &*1x,   *1 -> &1
+inline std::vector<RewriteRule> pattern_paper_rules() {
+    return {{"*", "1"}, {"&", "*1"}, {"*1", "&*1x"}, {"*1", "&1"}};
+}
+
+struct ExplorerConfig {
+    size_t max_depth = 8;        // rewrites applied to the start word
+    size_t max_length = 16;      // longer words are not kept
+    size_t max_words = 1 << 20;  // visited-set capacity; beyond it words are dropped
+    size_t threads = 0;          // 0: hardware_concurrency
+    std::string checkpoint;      // if set: resumed from when it holds this run, rewritten after every level
+};
+
+struct ExplorerStats {
+    size_t words = 0;                 // distinct words reached, start included
+    size_t levels = 0;                // depths fully expanded
+    std::vector<size_t> per_depth;    // words first reached at each depth
+    size_t distinct_hashes = 0;       // distinct hash_function_64 values among them
+    size_t hash_collisions = 0;       // words whose hash an earlier word already had
+    size_t dropped = 0;               // new words lost to the max_words bound
+    bool resumed = false;
+    std::string checkpoint_error;     // first checkpoint that could not be written; the run went on
+    double seconds = 0;
+};
+
+// Breadth-first enumeration of the words reachable from a start word, one
+// depth at a time so every word is recorded at its shortest derivation.
+// A level is spread over the workers' queues. A worker expands words from
+// the back of its own queue and, once that is empty, steals half of another
+// queue from the front. Successors go to the worker's queue for the next
+// level, so a level's queues only drain and a worker that finds every queue
+// empty is done.
+//
+// Visited words are deduplicated in a MemoryMT<depth>, which bounds memory at
+// max_words. A second MemoryMT keyed by each word's pattern hash counts
+// collisions. The visited set hashes with FastKeyHash: pattern-hash classes
+// run to thousands of words here, and a set keyed by the pattern hash alone
+// would merge them. With a checkpoint path the visited set is saved as a
+// MemorySnapshot after each level, together with one entry recording the
+// start word, the rules and the bounds. A run resumes from the deepest level
+// stored only if that record matches and the checkpoint is no deeper than
+// max_depth; otherwise it starts fresh and overwrites the checkpoint.
+class PatternExplorer {
+private:
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<std::string> words;
+    };
+
+    std::vector<RewriteRule> rules;
+    ExplorerConfig config;
+    size_t workers;
+    MemoryMT<uint32_t, FastKeyHash> visited;     // word -> depth first reached
+    BasicMemoryMT<uint64_t, uint32_t> hashes;    // pattern hash -> unused
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::atomic<size_t> collisions{0};
+    std::atomic<size_t> dropped{0};
+    std::string run_record;                      // checkpoint key describing this run (set by run())
+
+    // The checkpoint's key for the run exploring from start. It begins with
+    // a NUL and is longer than any word the run can store, so no word can
+    // take its place.
+    std::string make_run_record(std::string_view start) const {
+        std::string record(1, '\0');
+        auto field = [&](std::string_view s) {
+            record += std::to_string(s.size());
+            record += ':';
+            record += s;
+        };
+        field("pattern-explorer");
+        field(start);
+        for (const RewriteRule &rule : rules) {
+            field(rule.from);
+            field(rule.to);
+        }
+        field(std::to_string(config.max_length));
+        field(std::to_string(config.max_words));
+        if (record.size() <= config.max_length)
+            record.resize(config.max_length + 1, '\0');
+        return record;
+    }
+
+    // What a checkpoint holds: the run record, then every visited word.
+    struct Checkpoint {
+        const PatternExplorer &explorer;
+
+        template<typename Fn>
+        void for_each(Fn &&fn) const {
+            const uint32_t none = 0;
+            fn(std::string_view(explorer.run_record), none);
+            explorer.visited.for_each(fn);
+        }
+    };
+
+    // Records a word not seen before; returns false if it was known or dropped.
+    bool visit(std::string_view word, uint32_t depth) {
+        if (!visited.try_emplace(word, depth)) {
+            uint32_t known;
+            if (!visited.get(word, known))
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        uint64_t hash = hash_function_64(word.data(), word.size());
+        if (!hashes.try_emplace(hash, 0u))
+            collisions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(size_t self, std::string &word) {
+        WorkQueue &own = *queues[self];
+        std::lock_guard lock(own.mutex);
+        if (own.words.empty())
+            return false;
+        word = std::move(own.words.back());
+        own.words.pop_back();
+        return true;
+    }
+
+    // Takes half of the first non-empty queue after ours; one word is returned
+    // and the rest moved to our queue.
+    bool steal(size_t self, std::string &word) {
+        for (size_t k = 1; k < queues.size(); ++k) {
+            WorkQueue &victim = *queues[(self + k) % queues.size()];
+            std::vector<std::string> taken;
+            {
+                std::lock_guard lock(victim.mutex);
+                size_t n = (victim.words.size() + 1) / 2;
+                for (size_t i = 0; i < n; ++i) {
+                    taken.push_back(std::move(victim.words.front()));
+                    victim.words.pop_front();
+                }
+            }
+            if (taken.empty())
+                continue;
+            word = std::move(taken.back());
+            taken.pop_back();
+            if (!taken.empty()) {
+                WorkQueue &own = *queues[self];
+                std::lock_guard lock(own.mutex);
+                for (auto &w : taken)
+                    own.words.push_back(std::move(w));
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Expands every word of the current level; returns the next level per worker.
+    std::vector<std::vector<std::string>> expand_level(uint32_t depth, ThreadPool &pool) {
+        std::vector<std::vector<std::string>> next(workers);
+        pool.parallel_for(workers, [&](size_t self) {
+            std::string word, child;
+            while (pop(self, word) || steal(self, word)) {
+                for (const RewriteRule &rule : rules) {
+                    if (word.size() - rule.from.size() + rule.to.size() > config.max_length)
+                        continue;
+                    for (size_t at = word.find(rule.from); at != std::string::npos;
+                         at = word.find(rule.from, at + 1)) {
+                        child.assign(word, 0, at);
+                        child += rule.to;
+                        child.append(word, at + rule.from.size());
+                        if (visit(child, depth + 1))
+                            next[self].push_back(child);
+                    }
+                }
+            }
+        });
+        return next;
+    }
+
+    void fill_queues(std::vector<std::vector<std::string>> &&level) {
+        size_t target = 0;
+        for (auto &words : level)
+            for (auto &w : words)
+                queues[target++ % workers]->words.push_back(std::move(w));
+    }
+
+    // Restores the visited set from a checkpoint of this same run; returns
+    // the words of the deepest stored level, which were recorded but not yet
+    // expanded. A checkpoint of another run, or one deeper than max_depth,
+    // is left alone.
+    bool resume(uint32_t &depth, std::vector<std::vector<std::string>> &frontier) {
+        if (config.checkpoint.empty() || !std::filesystem::exists(config.checkpoint))
+            return false;
+        auto snapshot = MemorySnapshot<uint32_t, FastKeyHash>::open_mapped(config.checkpoint);
+        uint32_t unused;
+        if (!snapshot || !snapshot.get(run_record, unused))
+            return false;
+        depth = 0;
+        snapshot.for_each([&](std::string_view word, const uint32_t &d) {
+            if (word != run_record)
+                depth = std::max(depth, d);
+        });
+        if (depth > config.max_depth)
+            return false;
+        frontier.assign(1, {});
+        snapshot.for_each([&](std::string_view word, const uint32_t &d) {
+            if (word == run_record)
+                return;
+            visit(word, d);
+            if (d == depth)
+                frontier[0].emplace_back(word);
+        });
+        return true;
+    }
+
+public:
+    explicit PatternExplorer(std::vector<RewriteRule> rules = pattern_paper_rules(),
+                             ExplorerConfig config = ExplorerConfig())
+        : rules(std::move(rules)),
+          config(config),
+          workers(config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency())),
+          visited(config.max_words, 64),
+          hashes(config.max_words, 64) {
+        for (size_t i = 0; i < workers; ++i)
+            queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    ExplorerStats run(std::string_view start) {
+        auto started = std::chrono::steady_clock::now();
+        ExplorerStats stats;
+        uint32_t depth = 0;
+        std::vector<std::vector<std::string>> level;
+        run_record = make_run_record(start);
+        stats.resumed = resume(depth, level);
+        if (!stats.resumed) {
+            visit(start, 0);
+            level.assign(1, {std::string(start)});
+        }
+        ThreadPool pool(workers > 1 ? workers - 1 : 1); // parallel_for runs worker 0 here
+        while (depth < config.max_depth) {
+            fill_queues(std::move(level));
+            level = expand_level(depth, pool);
+            ++depth;
+            if (!config.checkpoint.empty() &&
+                !MemorySnapshot<uint32_t, FastKeyHash>::save(Checkpoint{*this}, config.checkpoint) &&
+                stats.checkpoint_error.empty())
+                stats.checkpoint_error = "could not write " + config.checkpoint + " after depth " +
+                                         std::to_string(depth);
+            size_t found = 0;
+            for (auto &words : level)
+                found += words.size();
+            if (found == 0)
+                break;
+        }
+        stats.levels = depth;
+        visited.for_each([&](std::string_view, uint32_t d) {
+            if (stats.per_depth.size() <= d)
+                stats.per_depth.resize(d + 1, 0);
+            ++stats.per_depth[d];
+        });
+        stats.words = visited.size();
+        stats.distinct_hashes = hashes.size();
+        stats.hash_collisions = collisions.load();
+        stats.dropped = dropped.load();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return stats;
+    }
+
+    // Depth at which word was first reached, if it was.
+    bool reached(std::string_view word, uint32_t &depth) const { return visited.get(word, depth); }
+
+    // Calls fn(word, depth) for every word reached.
+    template<typename Fn>
+    void for_each(Fn &&fn) const { visited.for_each(fn); }
+};
+
+#endif // PATTERN_EXPLORER_H
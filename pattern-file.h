@@ -0,0 +1,178 @@
+#ifndef PATTERN_FILE_H
+#define PATTERN_FILE_H
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pattern.h"
+#include "pattern-parallel.h"
+#include "pattern-stream.h"
+
+// Pattern hash of a file or a file descriptor.
+//
+// Regular files of kPatternMapThreshold bytes or more are mapped and hashed
+// in place, split across a pool once they pass kParallelHashThreshold.
+// Smaller files are read into one buffer. Pipes, terminals and sockets are
+// streamed: a reader thread fills one buffer while the caller hashes the
+// other, so the read and the kernel overlap.
+
+// Below this a read() is cheaper than setting up and tearing down a mapping.
+constexpr size_t kPatternMapThreshold = size_t(256) << 10;
+
+// Bytes per read-ahead buffer when streaming.
+constexpr size_t kPatternStreamBuffer = size_t(1) << 20;
+
+struct PatternFileHash {
+    PatternSegment segment;     // hash, LenSum and length of the whole input
+    std::string error;          // empty on success
+
+    bool ok() const { return error.empty(); }
+    uint64_t hash() const { return segment.hash; }
+};
+
+// Reads until `size` bytes are in or the input ends; returns the count, or -1.
+inline ssize_t pattern_read_full(int fd, char* buffer, size_t size) {
+    size_t filled = 0;
+    while (filled < size) {
+        ssize_t n = ::read(fd, buffer + filled, size - filled);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        filled += static_cast<size_t>(n);
+    }
+    return static_cast<ssize_t>(filled);
+}
+
+// Hashes fd to its end through two buffers: a reader thread fills one while
+// this thread hashes the other.
+inline PatternFileHash pattern_hash_stream(int fd, size_t buffer_size = kPatternStreamBuffer) {
+    struct Buffer {
+        std::vector<char> data;
+        ssize_t filled = 0;     // bytes in data; 0 at the end of input, -1 on a read error
+        bool full = false;      // owned by the hasher until it clears this
+    };
+    Buffer buffers[2];
+    buffers[0].data.resize(buffer_size);
+    buffers[1].data.resize(buffer_size);
+    std::mutex mutex;
+    std::condition_variable changed;
+    int read_errno = 0;
+
+    std::thread reader([&] {
+        for (size_t k = 0;; k ^= 1) {
+            Buffer &b = buffers[k];
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return !b.full; });
+            }
+            ssize_t n = pattern_read_full(fd, b.data.data(), buffer_size);
+            int err = errno;
+            {
+                std::lock_guard lock(mutex);
+                b.filled = n;
+                b.full = true;
+                if (n < 0)
+                    read_errno = err;
+            }
+            changed.notify_all();
+            if (n <= 0)
+                return;
+        }
+    });
+
+    PatternFileHash result;
+    PatternHasher hasher;
+    for (size_t k = 0;; k ^= 1) {
+        Buffer &b = buffers[k];
+        {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [&] { return b.full; });
+        }
+        if (b.filled < 0)
+            result.error = std::strerror(read_errno);
+        if (b.filled <= 0)
+            break;
+        hasher.update(b.data.data(), static_cast<size_t>(b.filled));
+        {
+            std::lock_guard lock(mutex);
+            b.full = false;
+        }
+        changed.notify_all();
+    }
+    reader.join();
+    result.segment = hasher.segment();
+    return result;
+}
+
+// Hashes an open descriptor: mapped if it is a large regular file, read in
+// one piece if it is a small one, streamed otherwise.
+inline PatternFileHash pattern_hash_fd(int fd, ThreadPool &pool = ThreadPool::shared()) {
+    PatternFileHash result;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        result.error = std::strerror(errno);
+        return result;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        result.error = "Is a directory";
+        return result;
+    }
+    if (!S_ISREG(st.st_mode))
+        return pattern_hash_stream(fd);
+
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size >= kPatternMapThreshold) {
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, size, MADV_SEQUENTIAL);
+            result.segment = pattern_segment_parallel(static_cast<const char*>(p), size, pool);
+            munmap(p, size);
+            return result;
+        }
+        // Some files report a size but cannot be mapped (procfs, some FUSE mounts).
+        return pattern_hash_stream(fd);
+    }
+
+    // One extra byte so a file that grew since fstat is noticed and streamed.
+    std::vector<char> buffer(size + 1);
+    ssize_t n = pattern_read_full(fd, buffer.data(), buffer.size());
+    if (n < 0) {
+        result.error = std::strerror(errno);
+        return result;
+    }
+    if (static_cast<size_t>(n) > size) {
+        PatternFileHash rest = pattern_hash_stream(fd);
+        result.segment = pattern_segment(buffer.data(), static_cast<size_t>(n));
+        result.segment.append(rest.segment);
+        result.error = rest.error;
+        return result;
+    }
+    result.segment = pattern_segment(buffer.data(), static_cast<size_t>(n));
+    return result;
+}
+
+inline PatternFileHash pattern_hash_file(const std::string &path, ThreadPool &pool = ThreadPool::shared()) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        PatternFileHash result;
+        result.error = std::strerror(errno);
+        return result;
+    }
+    PatternFileHash result = pattern_hash_fd(fd, pool);
+    ::close(fd);
+    return result;
+}
+
+#endif // PATTERN_FILE_H
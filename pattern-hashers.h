@@ -0,0 +1,143 @@
+#ifndef PATTERN_HASHERS_H
+#define PATTERN_HASHERS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include "pattern.h"
+
+// Key hashers for Memory, MemoryMT and MemorySnapshot. A hasher is any
+// callable uint64_t(std::string_view). A hasher may also provide
+// hash_many(span<const string_view>, uint64_t*), which the batch paths
+// (get_many, put_many) use through hash_keys().
+//
+// The pattern hash maps every byte except '*' and '&' to the same length, so
+// "key123" and "key456" share a hash and the hash range of n-byte keys is
+// only about n^2 values. PatternKeyHash keeps that behaviour (it is what the
+// tables are named for); MixedPatternKeyHash runs it through an avalanche
+// finalizer, which fixes the weak low bits that tags and home groups are cut
+// from but, being a bijection, cannot separate keys whose pattern hashes are
+// equal. FastKeyHash looks at every byte and is the one to use for arbitrary
+// keys. FixedKeyHash is the default for the inline keys of BasicMemory
+// (integers, enums, fixed-size arrays) and takes the key itself.
+
+// splitmix64 finalizer: every input bit flips about half of the output bits.
+inline uint64_t pattern_mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+struct PatternKeyHash {
+    uint64_t operator()(std::string_view key) const { return hash_function_64(key.data(), key.size()); }
+    void hash_many(std::span<const std::string_view> keys, uint64_t* out) const { ::hash_many(keys, out); }
+};
+
+struct MixedPatternKeyHash {
+    uint64_t operator()(std::string_view key) const {
+        return pattern_mix64(hash_function_64(key.data(), key.size()));
+    }
+    void hash_many(std::span<const std::string_view> keys, uint64_t* out) const {
+        ::hash_many(keys, out);
+        for (size_t i = 0; i < keys.size(); ++i)
+            out[i] = pattern_mix64(out[i]);
+    }
+};
+
+// Multiply-fold hash over 16-byte blocks: each step is one 64x64->128 bit
+// multiply with its halves xored together. Short keys cost two loads.
+struct FastKeyHash {
+    static constexpr uint64_t kP0 = 0xA0761D6478BD642FULL;
+    static constexpr uint64_t kP1 = 0xE7037ED1A0B428DBULL;
+    static constexpr uint64_t kP2 = 0x8EBC6AF09C88C6E3ULL;
+
+    __extension__ typedef unsigned __int128 u128; // GCC/Clang; silences -Wpedantic
+
+    static uint64_t fold(uint64_t a, uint64_t b) {
+        u128 r = static_cast<u128>(a) * b;
+        return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+    }
+
+    static uint64_t load64(const char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+
+    static uint64_t load32(const char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    uint64_t operator()(std::string_view key) const {
+        const char* p = key.data();
+        size_t n = key.size();
+        uint64_t h = kP0;
+        for (; n > 16; p += 16, n -= 16)
+            h = fold(load64(p) ^ kP1, load64(p + 8) ^ h);
+        uint64_t a = 0, b = 0;
+        if (n > 8) { // the two loads overlap for n < 16
+            a = load64(p);
+            b = load64(p + n - 8);
+        } else if (n >= 4) {
+            a = load32(p);
+            b = load32(p + n - 4);
+        } else if (n > 0) {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            a = (uint64_t(u[0]) << 16) | (uint64_t(u[n >> 1]) << 8) | u[n - 1];
+        }
+        h = fold(a ^ kP1, b ^ h);
+        return fold(h ^ key.size(), kP2);
+    }
+};
+
+// Keys of up to 8 bytes are one word through a single multiply-fold;
+// longer ones go through FastKeyHash's byte loop, whose branches fold away
+// since the length is a constant.
+struct FixedKeyHash {
+    template<typename Key>
+        requires std::is_trivially_copyable_v<Key> && std::has_unique_object_representations_v<Key>
+    uint64_t operator()(const Key &key) const {
+        const char* p = reinterpret_cast<const char*>(&key);
+        if constexpr (sizeof(Key) <= 8) {
+            uint64_t x = 0;
+            std::memcpy(&x, p, sizeof(Key));
+            return FastKeyHash::fold(x ^ FastKeyHash::kP1, FastKeyHash::kP2);
+        } else {
+            return FastKeyHash()(std::string_view(p, sizeof(Key)));
+        }
+    }
+};
+
+// Hashes keys into out[i], through hasher.hash_many when the hasher has one
+// and key by key otherwise.
+template<typename Hasher, typename Key>
+void hash_keys(const Hasher &hasher, std::span<const Key> keys, uint64_t* out) {
+    constexpr size_t kMaxBatch = 64;
+    if constexpr (std::is_convertible_v<const Key &, std::string_view> &&
+                  requires(std::span<const std::string_view> v) { hasher.hash_many(v, out); }) {
+        if constexpr (std::is_same_v<Key, std::string_view>) {
+            hasher.hash_many(keys, out);
+        } else {
+            std::string_view views[kMaxBatch];
+            for (size_t base = 0; base < keys.size(); base += kMaxBatch) {
+                size_t n = std::min(kMaxBatch, keys.size() - base);
+                for (size_t i = 0; i < n; ++i)
+                    views[i] = keys[base + i];
+                hasher.hash_many(std::span<const std::string_view>(views, n), out + base);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < keys.size(); ++i)
+            out[i] = hasher(keys[i]);
+    }
+}
+
+#endif // PATTERN_HASHERS_H
@@ -8,6 +8,7 @@
 #include <thread>
 #include <future>
 #include "pattern.h"
+#include "pattern-parallel.h"
 
 int main() {
     const size_t max_length = 1000000;   // Maximum string length: 1 million characters
@@ -80,5 +81,26 @@ int main() {
                   << std::hex << std::setw(16) << std::setfill('0') << hash_64 << std::endl;
     }
 
+    // --- Split-and-combine: one large input hashed across the pool ---
+    std::cout << std::dec << "\nParallel split-and-combine (" << ThreadPool::shared().size()
+              << " workers):" << std::endl;
+    for (size_t len : {size_t(1) << 20, size_t(16) << 20, size_t(64) << 20}) {
+        std::string big_str = generate_random_string(len);
+        const size_t big_iterations = 20;
+        uint64_t single = 0, parallel = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < big_iterations; ++i)
+            single = hash_function_64(big_str.c_str(), len);
+        auto mid = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < big_iterations; ++i)
+            parallel = hash_function_64_parallel(big_str.c_str(), len);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::micro> single_time = mid - start;
+        std::chrono::duration<double, std::micro> parallel_time = end - mid;
+        std::cout << "Length " << len << ": single = " << single_time.count() / big_iterations
+                  << " us, parallel = " << parallel_time.count() / big_iterations << " us, "
+                  << (single == parallel ? "hashes match" : "MISMATCH") << std::endl;
+    }
+
     return 0;
 }
@@ -4,9 +4,17 @@
 #include <chrono>
 #include <random>
 #include <vector>
+#include <string_view>
+#include <cstdlib>
 #include <iomanip>   // For std::hex, std::setw, and std::setfill
 
 #include "pattern.h"
+#include "pattern-stream.h"
+#include "pattern-alphabet.h"
+
+// Literal keys hash at compile time: -1 + 2*2 + 3*1 + 4*1 under the paper's Len.
+static_assert(PatternAlphabetHash<>::hash("*&1x") == 10);
+static_assert(PatternAlphabetHash<kPaperLenTable.with('x', 5)>::hash("*&1x") == 26);
 
 int main() {
     const size_t max_length = 1000000; // Maximum hash length: 1 million characters
@@ -17,43 +25,163 @@ int main() {
         std::string test_str = generate_random_string(len);
 
         // Test 32-bit hash
-        double total_time_32 = 0.0;
+        // Clock the whole loop: at 100 bytes a clock read costs as much as a hash.
         uint32_t hash_32 = 0;
-        for (size_t i = 0; i < num_iterations; ++i) {
-            auto start = std::chrono::high_resolution_clock::now();
-            hash_32 = hash_function_32(test_str.c_str(), len);
-            auto end = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::micro> duration = end - start;
-            total_time_32 += duration.count();
-        }
-        double average_time_32 = total_time_32 / num_iterations;
+        auto start_32 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < num_iterations; ++i)
+            hash_32 ^= hash_function_32(test_str.c_str(), len - (i & 1));
+        std::chrono::duration<double, std::micro> duration_32 = std::chrono::steady_clock::now() - start_32;
+        hash_32 = hash_function_32(test_str.c_str(), len);
+        double average_time_32 = duration_32.count() / num_iterations;
         std::cout << "32-bit Hash - Length " << len << ": Average time = " 
                   << average_time_32 << " microseconds, Hash = " << hash_32 << std::endl;
         std::cout << "Hash (hex): 0x"       // Prefix for clarity
               << std::hex               // Use hexadecimal format
               << std::setw(8)           // Set width to 8 characters
               << std::setfill('0')      // Pad with zeros if needed
-              << hash_32 << std::endl;     // Print the hash
+              << hash_32 << std::dec << std::endl; // Print the hash
 
         // Test 64-bit hash
-        double total_time_64 = 0.0;
         uint64_t hash_64 = 0;
-        for (size_t i = 0; i < num_iterations; ++i) {
-            auto start = std::chrono::high_resolution_clock::now();
-            hash_64 = hash_function_64(test_str.c_str(), len);
-            auto end = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::micro> duration = end - start;
-            total_time_64 += duration.count();
-        }
-        double average_time_64 = total_time_64 / num_iterations;
+        auto start_64 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < num_iterations; ++i)
+            hash_64 ^= hash_function_64(test_str.c_str(), len - (i & 1));
+        std::chrono::duration<double, std::micro> duration_64 = std::chrono::steady_clock::now() - start_64;
+        hash_64 = hash_function_64(test_str.c_str(), len);
+        double average_time_64 = duration_64.count() / num_iterations;
         std::cout << "64-bit Hash - Length " << len << ": Average time = " 
                   << average_time_64 << " microseconds, Hash = " << hash_64 << std::endl;
         std::cout << "Hash (hex): 0x"       // Prefix for clarity
               << std::hex               // Use hexadecimal format
               << std::setw(8)           // Set width to 8 characters
               << std::setfill('0')      // Pad with zeros if needed
-              << hash_64 << std::endl;     // Print the hash
+              << hash_64 << std::dec << std::endl; // Print the hash
+    }
+
+    // Kernel comparison: every supported kernel must agree with the asm
+    // reference, 64- and 32-bit, at every length up to 300 (the tails around
+    // each vector width) from unaligned starts, over random bytes and over
+    // symbols dense in '*' and '&'
+    std::cout << std::dec << "\nKernel comparison (active: "
+              << pattern_kernel_name(pattern_active_kernel()) << "):" << std::endl;
+    std::string kernel_str = generate_random_string(max_length);
+    uint64_t reference = hash_function_64_asm(kernel_str.c_str(), max_length);
+    const char symbols[] = "&*1x&*";
+    std::mt19937 gen(7);
+    std::string dense_str(4096, ' ');
+    for (char &c : dense_str)
+        c = symbols[gen() % 6];
+    for (PatternKernel kernel : {PatternKernel::Asm, PatternKernel::Scalar, PatternKernel::SSE2,
+                                 PatternKernel::AVX2, PatternKernel::AVX512}) {
+        if (!pattern_set_kernel(kernel)) {
+            std::cout << pattern_kernel_name(kernel) << ": not supported" << std::endl;
+            continue;
+        }
+        size_t kernel_mismatches = 0;
+        for (const std::string* input : {&kernel_str, &dense_str}) {
+            for (size_t offset = 0; offset < 64; offset += 9) {
+                const char* data = input->data() + offset;
+                for (size_t len = 0; len <= 300; ++len) {
+                    kernel_mismatches += hash_function_64(data, len) != hash_function_64_asm(data, len);
+                    kernel_mismatches += hash_function_32(data, len) != hash_function_32_asm(data, len);
+                }
+            }
+        }
+        const size_t kernel_iterations = 200;
+        uint64_t hash_64 = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kernel_iterations; ++i)
+            hash_64 = hash_function_64(kernel_str.c_str(), max_length);
+        std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+        std::cout << pattern_kernel_name(kernel) << ": " << duration.count() / kernel_iterations
+                  << " microseconds per " << max_length << " bytes, "
+                  << (hash_64 == reference ? "matches asm" : "MISMATCH") << "; lengths 0..300: "
+                  << kernel_mismatches << " mismatches" << std::endl;
+    }
+    pattern_set_kernel(PatternKernel::Auto);
+
+    // Multi-buffer: hash_many over keys of every length up to 130, some
+    // ending right at a page boundary, must match the one-key function
+    std::cout << "\nMulti-buffer hashing:" << std::endl;
+    char* page = static_cast<char*>(std::aligned_alloc(4096, 2 * 4096));
+    for (size_t i = 0; i < 2 * 4096; ++i)
+        page[i] = symbols[gen() % 6];
+    std::vector<std::string_view> many;
+    for (size_t len = 0; len <= 130; ++len) {
+        many.emplace_back(page + gen() % 4096, len);
+        many.emplace_back(page + 4096 - len, len);
+    }
+    std::vector<uint64_t> many_hashes(many.size());
+    for (PatternKernel kernel : {PatternKernel::Scalar, PatternKernel::SSE2, PatternKernel::AVX2,
+                                 PatternKernel::AVX512}) {
+        if (!pattern_set_kernel(kernel))
+            continue;
+        hash_many(many, many_hashes.data());
+        size_t many_mismatches = 0;
+        for (size_t i = 0; i < many.size(); ++i)
+            many_mismatches += many_hashes[i] != hash_function_64_asm(many[i].data(), many[i].size());
+        std::cout << pattern_kernel_name(kernel) << ": " << many.size() << " keys, "
+                  << many_mismatches << " mismatches" << std::endl;
+    }
+    pattern_set_kernel(PatternKernel::Auto);
+    std::free(page);
+
+    // Alphabet tables: the branchless table kernel under the paper's Len and
+    // under one with Len('x') = 5, against the asm loop and a plain sum
+    std::cout << "\nAlphabet tables:" << std::endl;
+    using WithX = PatternAlphabetHash<kPaperLenTable.with('x', 5)>;
+    std::string symbol_str(max_length, ' ');
+    for (char &c : symbol_str)
+        c = symbols[gen() % 6];
+    size_t table_mismatches = 0;
+    for (size_t len = 0; len < 300; ++len) {
+        uint64_t expected = 0;
+        for (size_t i = 0; i < len; ++i)
+            expected += (i + 1) * WithX::table[static_cast<unsigned char>(symbol_str[i])];
+        table_mismatches += WithX::hash(symbol_str.data(), len) != expected;
+        table_mismatches += PatternAlphabetHash<>::segment(symbol_str.data(), len).hash !=
+                            hash_function_64_asm(symbol_str.data(), len);
+    }
+    std::cout << "Lengths 0..299: " << table_mismatches << " mismatches" << std::endl;
+    for (const char* name : {"asm", "table", "table (x=5)"}) {
+        const size_t table_iterations = 200;
+        uint64_t hash_64 = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < table_iterations; ++i) {
+            size_t len = max_length - (i & 1);
+            const char* data = symbol_str.data();
+            asm volatile("" : "+r"(data)); // keeps the pure table hashes in the loop
+            if (name[0] == 'a')
+                hash_64 ^= hash_function_64_asm(data, len);
+            else if (name[5] == '\0')
+                hash_64 ^= PatternAlphabetHash<>::segment(data, len).hash;
+            else
+                hash_64 ^= WithX::hash(data, len);
+        }
+        std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+        volatile uint64_t sink = hash_64;
+        (void)sink;
+        std::cout << name << ": " << duration.count() / table_iterations << " microseconds per "
+                  << max_length << " random symbols" << std::endl;
+    }
+
+    // Streaming: feed the same input in uneven pieces, then slide a window over it
+    std::cout << "\nStreaming hasher:" << std::endl;
+    PatternHasher stream;
+    for (size_t pos = 0, piece = 1; pos < max_length; pos += piece, piece = piece * 3 % 4099 + 1)
+        stream.update(kernel_str.c_str() + pos, std::min(piece, max_length - pos));
+    std::cout << "Chunked update: " << (stream.finalize() == reference ? "matches one-shot" : "MISMATCH")
+              << std::endl;
+
+    const size_t window = 64;
+    PatternRollingHasher rolling(window);
+    size_t window_mismatches = 0;
+    for (size_t i = 0; i < 100000; ++i) {
+        rolling.push(kernel_str[i]);
+        if (rolling.full() && rolling.value() != hash_function_64(kernel_str.c_str() + i + 1 - window, window))
+            ++window_mismatches;
     }
+    std::cout << "Rolling window (" << window << " bytes): " << window_mismatches << " mismatches" << std::endl;
 
     return 0;
 }
\ No newline at end of file
@@ -8,11 +8,18 @@
 #include <thread>
 #include <future>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <memory>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <array>
 #include <unordered_map>
 
 #include "pattern.h"
 #include "patmemory.h"
+#include "patmemory-snapshot.h"
 
 int main() {
     // --- Testing Memory Data Structure ---
@@ -44,6 +51,24 @@ int main() {
     std::cout << "Add 3: " << (smallMem.put("three", 3) ? "success" : "failed") << std::endl;
     std::cout << "Add 4: " << (smallMem.put("four", 4) ? "success" : "failed") << std::endl;
 
+    // 2b. Growth, erase and load factor:
+    std::cout << "\n2b. Growth and Erase Test:" << std::endl;
+    Memory<int> growMem(3, MemoryGrowth::Double);
+    for (int i = 0; i < 1000; i++)
+        growMem.put("grow" + std::to_string(i), i);
+    std::cout << "Inserted 1000 items into initial capacity 3: size = " << growMem.size()
+              << ", slots = " << growMem.slot_count() << ", load factor = " << growMem.load_factor()
+              << std::endl;
+    size_t erased = 0;
+    for (int i = 0; i < 1000; i += 2)
+        erased += growMem.erase("grow" + std::to_string(i));
+    int probe = -1;
+    std::cout << "Erased " << erased << " items, size = " << growMem.size() << ", grow1 "
+              << (growMem.get("grow1", probe) ? "found" : "missing") << ", grow2 "
+              << (growMem.get("grow2", probe) ? "found" : "missing") << std::endl;
+    growMem.set_max_load_factor(0.5);
+    std::cout << "Max load factor 0.5: slots = " << growMem.slot_count() << std::endl;
+
     // 3. Performance Test with Large Dataset:
     std::cout << "\n3. Performance Test with Large Dataset:" << std::endl;
     const size_t TEST_SIZES[] = {1000000, 5000000, 20000000}; // 1M, 5M, 20M records
@@ -51,16 +76,24 @@ int main() {
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> dis(1, 1000000);
 
+    // Keys are formatted into one buffer and passed as string_views, so the
+    // loops below measure the table rather than std::string allocation.
+    char keyBuf[32] = "key";
+    auto key_for = [&keyBuf](size_t i) {
+        char* end = std::to_chars(keyBuf + 3, keyBuf + sizeof(keyBuf), i).ptr;
+        return std::string_view(keyBuf, static_cast<size_t>(end - keyBuf));
+    };
+
     for (size_t testSize : TEST_SIZES) {
         std::cout << "\nTesting with " << testSize << " records:" << std::endl;
-        Memory<int> largeMem(testSize);
+        // "key" + i keys only differ outside the pattern alphabet, where the
+        // pattern hash sees nothing; section 6 shows the clustering it causes.
+        Memory<int, FastKeyHash> largeMem(testSize);
 
         // Insert performance
         auto start = std::chrono::high_resolution_clock::now();
-        for (size_t i = 0; i < testSize; i++) {
-            std::string key = "key" + std::to_string(i);
-            largeMem.put(key, dis(gen));
-        }
+        for (size_t i = 0; i < testSize; i++)
+            largeMem.put(key_for(i), dis(gen));
         auto end = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
         std::cout << "Insert time: " << duration.count() << " ms" << std::endl;
@@ -68,24 +101,38 @@ int main() {
 
         // Lookup performance
         size_t lookupCount = 10000;
+        size_t hits = 0; // keeps the lookups from being optimised away
         start = std::chrono::high_resolution_clock::now();
         for (size_t i = 0; i < lookupCount; i++) {
-            std::string key = "key" + std::to_string(dis(gen) % testSize);
             int val;
-            largeMem.get(key, val);
+            hits += largeMem.get(key_for(dis(gen) % testSize), val);
         }
         end = std::chrono::high_resolution_clock::now();
         auto lookup_duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-        std::cout << "Lookup time (" << lookupCount << " random lookups): " 
+        std::cout << "Lookup time (" << lookupCount << " random lookups, " << hits << " hits): "
                   << lookup_duration.count() << " μs" << std::endl;
         std::cout << "Average lookup time: " << (lookup_duration.count() / lookupCount) 
                   << " μs/lookup" << std::endl;
 
-        // Memory usage estimate (approximate)
-        size_t approxMemUsage = (sizeof(std::string) + sizeof(int)) * testSize + 
-                              sizeof(std::unordered_map<std::string, int>);
-        std::cout << "Approximate memory usage: " << (approxMemUsage / 1024.0 / 1024.0) 
-                  << " MB" << std::endl;
+        // Batched lookup performance (keys built before the clock starts)
+        std::vector<std::string> batchKeys;
+        batchKeys.reserve(lookupCount);
+        for (size_t i = 0; i < lookupCount; i++)
+            batchKeys.push_back(std::string(key_for(dis(gen) % testSize)));
+        std::vector<int> batchValues(lookupCount);
+        start = std::chrono::high_resolution_clock::now();
+        size_t batchHits = largeMem.get_many(batchKeys, batchValues);
+        end = std::chrono::high_resolution_clock::now();
+        auto batch_duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        std::cout << "Batched lookup time (" << lookupCount << " random lookups, " << batchHits << " hits): "
+                  << batch_duration.count() << " μs" << std::endl;
+
+        // Memory usage: allocated control bytes, slots and key arena
+        MemoryStats largeStats = largeMem.stats();
+        std::cout << "Memory usage: " << (largeStats.bytes_total / 1024.0 / 1024.0) << " MB (slots "
+                  << (largeStats.bytes_slots / 1024.0 / 1024.0) << " MB, keys "
+                  << (largeStats.bytes_keys / 1024.0 / 1024.0) << " MB), load factor "
+                  << largeStats.load_factor << std::endl;
     }
 
     // 4. Edge Cases:
@@ -96,5 +143,212 @@ int main() {
     if (edgeMem.get("", value))
         std::cout << "Retrieved empty key value: " << value << std::endl;
 
+    // 5. Snapshot Test:
+    std::cout << "\n5. Snapshot Test:" << std::endl;
+    const size_t snapKeys = 20000;
+    Memory<int> snapMem(snapKeys);
+    std::vector<std::string> snapKeyList;
+    std::mt19937 snap_gen(11);
+    for (size_t i = 0; i < snapKeys; ++i) {
+        std::string key(32, ' ');
+        for (char &c : key)
+            c = "*&1x"[snap_gen() % 4];
+        snapKeyList.push_back(key);
+        snapMem.put(key, static_cast<int>(i));
+    }
+    std::string snapPath = (std::filesystem::temp_directory_path() / "pattern-memory.snap").string();
+    auto snap_start = std::chrono::steady_clock::now();
+    bool saved = MemorySnapshot<int>::save(snapMem, snapPath);
+    auto snap_saved = std::chrono::steady_clock::now();
+    MemorySnapshot<int> snapshot = MemorySnapshot<int>::open_mapped(snapPath);
+    auto snap_opened = std::chrono::steady_clock::now();
+    size_t snapMismatches = 0;
+    for (size_t i = 0; i < snapKeys; ++i) {
+        int expected = -1, mapped = -2;
+        snapMem.get(snapKeyList[i], expected);
+        snapshot.get(snapKeyList[i], mapped);
+        snapMismatches += expected != mapped;
+    }
+    std::cout << "Save: " << (saved ? "success" : "failed") << " in "
+              << std::chrono::duration<double, std::milli>(snap_saved - snap_start).count() << " ms, open: "
+              << (snapshot ? "success" : snapshot.error()) << " in "
+              << std::chrono::duration<double, std::milli>(snap_opened - snap_saved).count() << " ms ("
+              << snapshot.mapped_bytes() / 1024 << " KB)" << std::endl;
+    std::cout << "Mapped entries: " << snapshot.size() << ", lookup mismatches: " << snapMismatches << std::endl;
+    Memory<int> writable(snapshot.size());
+    std::cout << "Copied into writable table: " << snapshot.copy_into(writable) << " entries" << std::endl;
+
+    // Flip one byte in the middle of the file; the checksum must reject it.
+    {
+        std::streamoff middle = static_cast<std::streamoff>(snapshot.mapped_bytes() / 2);
+        std::fstream file(snapPath, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(middle);
+        char byte = static_cast<char>(file.get());
+        file.seekp(middle);
+        file.put(static_cast<char>(byte ^ 0x10));
+    }
+    MemorySnapshot<int> corrupt = MemorySnapshot<int>::open_mapped(snapPath);
+    std::cout << "Corrupted snapshot: " << (corrupt ? "accepted" : corrupt.error()) << std::endl;
+    std::filesystem::remove(snapPath);
+
+    // 6. Key Distribution:
+    std::cout << "\n6. Key Distribution (100000 keys \"key\" + i):" << std::endl;
+    std::vector<std::string> distKeys;
+    for (size_t i = 0; i < 100000; ++i)
+        distKeys.push_back("key" + std::to_string(i));
+    auto report = [](const char* name, const KeyDistribution &d) {
+        std::cout << std::left << std::setw(22) << name << std::right << "distinct hashes " << d.distinct_hashes
+                  << ", collision rate " << d.collision_rate << ", probe mean " << d.mean_probe << " max "
+                  << d.max_probe << ", longest cluster " << d.longest_cluster << " of " << d.groups
+                  << " groups" << std::endl;
+    };
+    report("PatternKeyHash", analyze_key_distribution<PatternKeyHash>(distKeys));
+    report("MixedPatternKeyHash", analyze_key_distribution<MixedPatternKeyHash>(distKeys));
+    report("FastKeyHash", analyze_key_distribution<FastKeyHash>(distKeys));
+
+    // 7. Stats:
+    std::cout << "\n7. Stats (compile with -DPATMEMORY_STATS for event counters):" << std::endl;
+    Memory<int, FastKeyHash> statsMem(1000, MemoryGrowth::Fixed);
+    for (size_t i = 0; i < 1200; ++i)
+        statsMem.put(distKeys[i], static_cast<int>(i));
+    int statsValue;
+    for (size_t i = 0; i < 2000; ++i)
+        statsMem.get(distKeys[i], statsValue);
+    for (size_t i = 0; i < 100; ++i)
+        statsMem.erase(distKeys[i]);
+    std::cout << statsMem.stats().to_json() << std::endl;
+
+    // 8. Cache Mode:
+    std::cout << "\n8. Cache Mode (MemoryGrowth::Evict):" << std::endl;
+    Memory<int, FastKeyHash> cache(3, MemoryGrowth::Evict);
+    cache.put("one", 1);
+    cache.put("two", 2);
+    cache.put("three", 3);
+    int cached;
+    cache.get("one", cached);   // referenced: survives the next sweep
+    cache.get("three", cached);
+    std::cout << "Add four: " << (cache.put("four", 4) ? "success" : "failed")
+              << ", evictions: " << cache.evictions() << std::endl;
+    for (const char* key : {"one", "two", "three", "four"})
+        std::cout << key << (cache.get(key, cached) ? " cached" : " evicted") << std::endl;
+
+    // Skewed reads through a 5000-entry cache of 100000 keys: CLOCK against a
+    // std::list LRU, the usual wrapper. A miss computes the value and puts it.
+    const size_t cacheKeys = 100000, cacheCap = 5000, cacheOps = 2000000;
+    std::vector<std::string> cacheKeySet;
+    cacheKeySet.reserve(cacheKeys);
+    for (size_t i = 0; i < cacheKeys; ++i)
+        cacheKeySet.push_back("derived/" + std::to_string(i));
+    std::vector<double> weights(cacheKeys);
+    for (size_t i = 0; i < cacheKeys; ++i)
+        weights[i] = 1.0 / static_cast<double>(i + 1); // Zipf, s = 1
+    std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+    std::mt19937 cacheGen(7);
+    std::vector<uint32_t> trace(cacheOps);
+    for (auto &k : trace)
+        k = static_cast<uint32_t>(zipf(cacheGen));
+
+    Memory<int, FastKeyHash> clock(cacheCap, MemoryGrowth::Evict);
+    size_t clockHits = 0;
+    auto clock_start = std::chrono::high_resolution_clock::now();
+    for (uint32_t k : trace) {
+        if (clock.get(cacheKeySet[k], cached))
+            ++clockHits;
+        else
+            clock.put(cacheKeySet[k], static_cast<int>(k));
+    }
+    std::chrono::duration<double> clockTime = std::chrono::high_resolution_clock::now() - clock_start;
+
+    std::list<std::pair<std::string, int>> lruOrder;
+    std::unordered_map<std::string_view, std::list<std::pair<std::string, int>>::iterator> lruIndex;
+    lruIndex.reserve(cacheCap);
+    size_t lruHits = 0;
+    auto lru_start = std::chrono::high_resolution_clock::now();
+    for (uint32_t k : trace) {
+        auto it = lruIndex.find(cacheKeySet[k]);
+        if (it != lruIndex.end()) {
+            ++lruHits;
+            lruOrder.splice(lruOrder.begin(), lruOrder, it->second);
+            continue;
+        }
+        if (lruOrder.size() == cacheCap) {
+            lruIndex.erase(lruOrder.back().first);
+            lruOrder.pop_back();
+        }
+        lruOrder.emplace_front(cacheKeySet[k], static_cast<int>(k));
+        lruIndex.emplace(lruOrder.front().first, lruOrder.begin());
+    }
+    std::chrono::duration<double> lruTime = std::chrono::high_resolution_clock::now() - lru_start;
+
+    MemoryStats clockStats = clock.stats(); // a cache counts hits and misses in every build
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "CLOCK:     hit rate " << 100.0 * clockStats.hits / clockStats.lookups << "%, "
+              << cacheOps / clockTime.count() / 1e6 << " Mops/sec, evictions: " << clockStats.evictions
+              << (clockStats.hits == clockHits && clockStats.lookups == cacheOps ? "" : " (COUNTS DIFFER)")
+              << std::endl;
+    std::cout << "List LRU:  hit rate " << 100.0 * lruHits / cacheOps << "%, "
+              << cacheOps / lruTime.count() / 1e6 << " Mops/sec" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << clockStats.to_json() << std::endl;
+
+    // 9. Integer Keys:
+    std::cout << "\n9. Integer Keys (BasicMemory<uint64_t, Value>):" << std::endl;
+    const size_t idCount = 1000000;
+    std::vector<uint64_t> ids(idCount);
+    std::mt19937_64 idGen(11);
+    for (auto &id : ids)
+        id = idGen();
+    Memory<int, FastKeyHash> byString(idCount);
+    BasicMemory<uint64_t, int> byId(idCount);
+    for (size_t i = 0; i < idCount; ++i) {
+        byString.put(std::to_string(ids[i]), static_cast<int>(i));
+        byId.put(ids[i], static_cast<int>(i));
+    }
+    int idValue;
+    size_t stringHits = 0, idHits = 0;
+    auto string_start = std::chrono::high_resolution_clock::now();
+    for (uint64_t id : ids)
+        stringHits += byString.get(std::to_string(id), idValue);
+    std::chrono::duration<double> stringTime = std::chrono::high_resolution_clock::now() - string_start;
+    auto id_start = std::chrono::high_resolution_clock::now();
+    for (uint64_t id : ids)
+        idHits += byId.get(id, idValue);
+    std::chrono::duration<double> idTime = std::chrono::high_resolution_clock::now() - id_start;
+    std::cout << "to_string keys: " << stringHits << " hits, " << idCount / stringTime.count() / 1e6
+              << " Mops/sec, " << byString.stats().bytes_total / idCount << " bytes/entry" << std::endl;
+    std::cout << "uint64_t keys:  " << idHits << " hits, " << idCount / idTime.count() / 1e6
+              << " Mops/sec, " << byId.stats().bytes_total / idCount << " bytes/entry" << std::endl;
+    BasicMemory<std::array<char, 16>, int> digests(4);
+    std::array<char, 16> digest{};
+    std::memcpy(digest.data(), "0123456789abcdef", 16);
+    digests.put(digest, 16);
+    if (digests.get(digest, idValue))
+        std::cout << "std::array<char, 16> key: " << idValue << std::endl;
+
+    // 10. Views:
+    std::cout << "\n10. Views (point-in-time, copied as writers touch each group):" << std::endl;
+    auto view_start = std::chrono::high_resolution_clock::now();
+    auto idView = byId.view();
+    std::chrono::duration<double, std::micro> viewTime = std::chrono::high_resolution_clock::now() - view_start;
+    auto write_start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < idCount; i += 2)
+        byId.put(ids[i], -1);
+    for (size_t i = 1; i < idCount; i += 4)
+        byId.erase(ids[i]);
+    for (uint64_t i = 0; i < idCount / 4; ++i)
+        byId.put(idGen(), 0);
+    std::chrono::duration<double> writeTime = std::chrono::high_resolution_clock::now() - write_start;
+    std::vector<uint64_t> workerSums(ThreadPool::shared().size() + 1);
+    idView.parallel_for_each([&](size_t worker, uint64_t, const int &value) { workerSums[worker] += value; });
+    uint64_t viewSum = 0;
+    for (uint64_t sum : workerSums)
+        viewSum += sum;
+    std::cout << "view of " << idView.size() << " entries taken in " << static_cast<long>(viewTime.count()) << " us"
+              << std::endl;
+    std::cout << idCount << " writes afterwards: " << idCount / writeTime.count() / 1e6 << " Mops/sec, live table "
+              << byId.size() << " entries" << std::endl;
+    std::cout << "view still sums to " << viewSum << " (expected " << uint64_t(idCount) * (idCount - 1) / 2 << ")"
+              << std::endl;
+
     return 0;
 }
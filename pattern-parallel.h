@@ -0,0 +1,54 @@
+#ifndef PATTERN_PARALLEL_H
+#define PATTERN_PARALLEL_H
+
+#include <cstdint>
+#include <vector>
+#include "pattern.h"
+#include "pattern-threadpool.h"
+
+// Inputs below this size are hashed on the calling thread; the hand-off to the
+// pool costs more than the kernels need for a megabyte.
+constexpr size_t kParallelHashThreshold = size_t(1) << 20;
+
+// Smallest slice handed to a worker; keeps chunks whole cache lines apart.
+constexpr size_t kParallelHashMinChunk = size_t(256) << 10;
+
+// Splits str across the pool, summarises each chunk as (hash, LenSum, length)
+// and stitches the summaries left to right. Bit-identical to pattern_segment().
+inline PatternSegment pattern_segment_parallel(const char* str, size_t len,
+                                               ThreadPool& pool = ThreadPool::shared(),
+                                               size_t threshold = kParallelHashThreshold) {
+    size_t chunks = len / kParallelHashMinChunk;
+    if (chunks > pool.size() + 1) chunks = pool.size() + 1;
+    if (len < threshold || chunks < 2)
+        return pattern_segment(str, len);
+
+    // Chunk boundaries on 64-byte multiples so no vector block straddles two chunks.
+    size_t chunk_len = ((len + chunks - 1) / chunks + 63) & ~size_t(63);
+    chunks = (len + chunk_len - 1) / chunk_len;
+    std::vector<PatternSegment> parts(chunks);
+    pool.parallel_for(chunks, [&](size_t i) {
+        size_t begin = i * chunk_len;
+        size_t end = begin + chunk_len < len ? begin + chunk_len : len;
+        parts[i] = pattern_segment(str + begin, end - begin);
+    });
+
+    PatternSegment result;
+    for (const auto &part : parts)
+        result.append(part);
+    return result;
+}
+
+inline uint64_t hash_function_64_parallel(const char* str, size_t len,
+                                          ThreadPool& pool = ThreadPool::shared(),
+                                          size_t threshold = kParallelHashThreshold) {
+    return pattern_segment_parallel(str, len, pool, threshold).hash;
+}
+
+inline uint32_t hash_function_32_parallel(const char* str, size_t len,
+                                          ThreadPool& pool = ThreadPool::shared(),
+                                          size_t threshold = kParallelHashThreshold) {
+    return static_cast<uint32_t>(pattern_segment_parallel(str, len, pool, threshold).hash);
+}
+
+#endif // PATTERN_PARALLEL_H
@@ -0,0 +1,93 @@
+#include <cstdint>
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "pattern.h"
+#include "pattern-search.h"
+
+// Log-like text: mostly symbol runs over '*', '&', '1', 'x' with words mixed in.
+std::string generate_symbol_log(size_t length, std::mt19937& gen) {
+    const char symbols[] = {'*', '&', '1', 'x'};
+    const char* words[] = {"INFO ", "WARN ", "id=", " -> ", "\n"};
+    std::uniform_int_distribution<> pick(0, 9);
+    std::string result;
+    result.reserve(length + 8);
+    while (result.size() < length) {
+        int r = pick(gen);
+        if (r == 0)
+            result += words[gen() % 5];
+        else
+            result += symbols[r % 4];
+    }
+    result.resize(length);
+    return result;
+}
+
+int main() {
+    std::mt19937 gen(42);
+    const char symbols[] = {'*', '&', '1', 'x'};
+
+    // 1. Basic Functionality Test:
+    std::cout << "\n1. Basic Functionality Test:" << std::endl;
+    PatternSearcher basic;
+    basic.add("*&1");
+    basic.add("x*");
+    basic.add("&&&&&&&&&&");
+    std::string text = "1x*&1x*&&&&&&&&&&&x";
+    for (const PatternMatch &m : basic.search(text))
+        std::cout << "\"" << basic.pattern(m.pattern) << "\" at " << m.position << std::endl;
+
+    // 2. Correctness against a naive scan with thousands of patterns:
+    std::cout << "\n2. Naive Comparison Test:" << std::endl;
+    PatternSearcher searcher;
+    std::vector<std::string> patterns;
+    for (size_t i = 0; i < 5000; ++i) {
+        std::string p(6 + gen() % 12, ' ');
+        for (char &c : p)
+            c = symbols[gen() % 4];
+        patterns.push_back(p);
+        searcher.add(p);
+    }
+    searcher.build();
+    std::string small_log = generate_symbol_log(20000, gen);
+    std::vector<PatternMatch> naive;
+    for (uint32_t id = 0; id < patterns.size(); ++id)
+        for (size_t pos = small_log.find(patterns[id]); pos != std::string::npos;
+             pos = small_log.find(patterns[id], pos + 1))
+            naive.push_back({pos, id});
+    std::sort(naive.begin(), naive.end());
+    std::vector<PatternMatch> found = searcher.search(small_log);
+    std::cout << "Matches: " << found.size() << ", naive: " << naive.size() << ", "
+              << (found == naive ? "identical" : "MISMATCH") << std::endl;
+
+    // 3. Performance Test with Large Dataset:
+    std::cout << "\n3. Performance Test with Large Dataset:" << std::endl;
+    for (size_t len : {size_t(1) << 20, size_t(16) << 20}) {
+        std::string log = generate_symbol_log(len, gen);
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<PatternMatch> single = searcher.search(log.c_str(), len, ThreadPool::shared(), SIZE_MAX);
+        auto mid = std::chrono::high_resolution_clock::now();
+        std::vector<PatternMatch> parallel = searcher.search(log.c_str(), len);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto single_ms = std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count();
+        auto parallel_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count();
+        std::cout << "Length " << len << ", " << patterns.size() << " patterns: " << parallel.size()
+                  << " matches, single thread " << single_ms << " ms, pool " << parallel_ms << " ms, "
+                  << (single == parallel ? "results agree" : "MISMATCH") << std::endl;
+    }
+
+    // 4. Edge Cases:
+    std::cout << "\n4. Edge Cases:" << std::endl;
+    PatternSearcher edge;
+    edge.add("");
+    edge.add("longer than the text");
+    std::cout << "Matches in short text: " << edge.search("short").size() << std::endl;
+    std::cout << "Matches in empty text: " << edge.search("").size() << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+#ifndef PATTERN_SEARCH_H
+#define PATTERN_SEARCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "pattern.h"
+#include "pattern-threadpool.h"
+
+// Rabin-Karp style multi-pattern search on top of the pattern hash.
+//
+// Patterns are grouped by length. For a block of text we build two prefix
+// arrays over Len, P[i] = sum_{k<i} Len(t_k) and Q[i+1] = Q[i] - P[i], which
+// gives every window hash of width w without multiplying by positions:
+//     H(t[s, s+w)) = Q[s+w] - Q[s] + w * P[s+w]
+// That loop is branch-free and runs 4 windows per AVX2 step. The pattern hash
+// alone maps every non-symbol byte to 1, so candidates are keyed on the hash
+// mixed with the first (up to) 8 bytes, filtered through a bitset, and only
+// then looked up in the sorted index and verified with memcmp.
+
+struct PatternMatch {
+    size_t position;
+    uint32_t pattern;
+
+    bool operator<(const PatternMatch& other) const {
+        return position != other.position ? position < other.position : pattern < other.pattern;
+    }
+    bool operator==(const PatternMatch& other) const = default;
+};
+
+// Inputs below this size are scanned on the calling thread.
+constexpr size_t kParallelSearchThreshold = size_t(1) << 20;
+
+class PatternSearcher {
+private:
+    static constexpr size_t kBlock = 16384;   // window starts per prefix block
+    static constexpr uint64_t kPrefixMix = 0x9E3779B97F4A7C15ULL;
+
+    struct IndexEntry {
+        uint64_t key;
+        uint32_t pattern;
+        bool operator<(const IndexEntry& other) const { return key < other.key; }
+    };
+
+    struct Group {
+        size_t width = 0;
+        size_t prefix_bytes = 0;            // min(width, 8)
+        uint64_t prefix_mask = 0;
+        unsigned filter_shift = 0;
+        std::vector<uint64_t> filter;       // one bit per (key * kPrefixMix) >> shift
+        std::vector<IndexEntry> index;      // sorted by key
+    };
+
+    std::vector<std::string> patterns;
+    std::vector<Group> groups;
+    size_t max_width = 0;
+
+    static uint64_t load_prefix(const char* p, size_t bytes) {
+        uint64_t word = 0;
+        std::memcpy(&word, p, bytes);
+        return word;
+    }
+
+    static uint64_t make_key(uint64_t hash, uint64_t prefix) {
+        return hash ^ (prefix * kPrefixMix);
+    }
+
+    bool filter_hit(const Group& g, uint64_t key) const {
+        uint64_t bit = (key * kPrefixMix) >> g.filter_shift;
+        return (g.filter[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    // P and Q over text[0, n); P and Q have n + 1 entries.
+    static void build_prefix(const char* text, size_t n, std::vector<int64_t>& P, std::vector<uint64_t>& Q) {
+        P.resize(n + 1);
+        Q.resize(n + 1);
+        P[0] = 0;
+        Q[0] = 0;
+        for (size_t i = 0; i < n; ++i) {
+            Q[i + 1] = Q[i] - static_cast<uint64_t>(P[i]);
+            P[i + 1] = P[i] + 1 + pattern_delta(static_cast<unsigned char>(text[i]));
+        }
+    }
+
+    // out[s] = H(text[s, s+w)) for s in [0, count). P must fit in 32 bits.
+    static void window_hashes_scalar(const int64_t* P, const uint64_t* Q, size_t w, size_t count, uint64_t* out) {
+        for (size_t s = 0; s < count; ++s)
+            out[s] = Q[s + w] - Q[s] + w * static_cast<uint64_t>(P[s + w]);
+    }
+
+#ifdef PATTERN_X86_64
+    __attribute__((target("avx2")))
+    static void window_hashes_avx2(const int64_t* P, const uint64_t* Q, size_t w, size_t count, uint64_t* out) {
+        // mul_epi32 multiplies the sign-extended low dwords, exact while |P|, w < 2^31
+        const __m256i vw = _mm256_set1_epi64x(static_cast<int64_t>(w));
+        size_t s = 0;
+        for (; s + 4 <= count; s += 4) {
+            __m256i q_end = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Q + s + w));
+            __m256i q_begin = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Q + s));
+            __m256i p_end = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(P + s + w));
+            __m256i h = _mm256_add_epi64(_mm256_sub_epi64(q_end, q_begin), _mm256_mul_epi32(p_end, vw));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + s), h);
+        }
+        window_hashes_scalar(P + s, Q + s, w, count - s, out + s);
+    }
+#endif
+
+    // |P| <= 2 * span, so the 32-bit multiply is exact while span < 2^29.
+    static void window_hashes(const int64_t* P, const uint64_t* Q, size_t span, size_t w, size_t count,
+                              uint64_t* out) {
+#ifdef PATTERN_X86_64
+        if (span < (size_t(1) << 29) && __builtin_cpu_supports("avx2")) {
+            window_hashes_avx2(P, Q, w, count, out);
+            return;
+        }
+#endif
+        window_hashes_scalar(P, Q, w, count, out);
+    }
+
+    // Window starts in [begin, end) of text[0, len); appends matches to out.
+    void scan_range(const char* text, size_t len, size_t begin, size_t end, std::vector<PatternMatch>& out) const {
+        std::vector<int64_t> P;
+        std::vector<uint64_t> Q;
+        std::vector<uint64_t> hashes(kBlock);
+        for (size_t block = begin; block < end; block += kBlock) {
+            size_t starts = std::min(kBlock, end - block);
+            size_t span = std::min(starts + max_width - 1, len - block);
+            build_prefix(text + block, span, P, Q);
+            for (const Group& g : groups) {
+                if (g.width > span)
+                    continue;
+                size_t count = std::min(starts, span - g.width + 1);
+                window_hashes(P.data(), Q.data(), span, g.width, count, hashes.data());
+                // Full 8-byte loads wherever the text allows, masked to the width
+                size_t wide = len - block >= 8 ? std::min(count, len - block - 7) : 0;
+                for (size_t s = 0; s < count; ++s) {
+                    const char* window = text + block + s;
+                    uint64_t prefix = s < wide ? load_prefix(window, 8) & g.prefix_mask
+                                               : load_prefix(window, g.prefix_bytes);
+                    uint64_t key = make_key(hashes[s], prefix);
+                    if (!filter_hit(g, key))
+                        continue;
+                    auto range = std::equal_range(g.index.begin(), g.index.end(), IndexEntry{key, 0});
+                    for (auto it = range.first; it != range.second; ++it)
+                        if (std::memcmp(window, patterns[it->pattern].data(), g.width) == 0)
+                            out.push_back({block + s, it->pattern});
+                }
+            }
+        }
+    }
+
+public:
+    // Registers a pattern and returns its id. Empty patterns never match.
+    uint32_t add(std::string_view pattern) {
+        patterns.emplace_back(pattern);
+        groups.clear();
+        return static_cast<uint32_t>(patterns.size() - 1);
+    }
+
+    size_t size() const { return patterns.size(); }
+    const std::string& pattern(uint32_t id) const { return patterns[id]; }
+
+    // Builds the per-length indexes; called by search() if patterns changed.
+    void build() {
+        groups.clear();
+        max_width = 0;
+        std::vector<uint32_t> order;
+        for (uint32_t id = 0; id < patterns.size(); ++id)
+            if (!patterns[id].empty())
+                order.push_back(id);
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return patterns[a].size() < patterns[b].size();
+        });
+        for (size_t i = 0; i < order.size();) {
+            Group g;
+            g.width = patterns[order[i]].size();
+            g.prefix_bytes = std::min<size_t>(g.width, 8);
+            g.prefix_mask = g.width >= 8 ? ~uint64_t(0) : (uint64_t(1) << (8 * g.width)) - 1;
+            size_t j = i;
+            for (; j < order.size() && patterns[order[j]].size() == g.width; ++j) {
+                const std::string& p = patterns[order[j]];
+                uint64_t key = make_key(hash_function_64(p.data(), p.size()), load_prefix(p.data(), g.prefix_bytes));
+                g.index.push_back({key, order[j]});
+            }
+            std::sort(g.index.begin(), g.index.end());
+            size_t bits = 64;
+            unsigned log_bits = 6;
+            while (bits < 16 * g.index.size()) {
+                bits <<= 1;
+                ++log_bits;
+            }
+            g.filter.assign(bits / 64, 0);
+            g.filter_shift = 64 - log_bits;
+            for (const IndexEntry& e : g.index) {
+                uint64_t bit = (e.key * kPrefixMix) >> g.filter_shift;
+                g.filter[bit >> 6] |= uint64_t(1) << (bit & 63);
+            }
+            max_width = g.width;
+            groups.push_back(std::move(g));
+            i = j;
+        }
+    }
+
+    // All occurrences of all patterns in text, sorted by position then id.
+    // Builds the index on first use; call build() up front before searching
+    // from several threads.
+    std::vector<PatternMatch> search(const char* text, size_t len,
+                                     ThreadPool& pool = ThreadPool::shared(),
+                                     size_t threshold = kParallelSearchThreshold) {
+        if (groups.empty())
+            build();
+        std::vector<PatternMatch> matches;
+        if (groups.empty() || len < groups.front().width)
+            return matches;
+        size_t starts = len - groups.front().width + 1;
+        size_t chunks = std::min(pool.size() + 1, (starts + kBlock - 1) / kBlock);
+        if (len < threshold || chunks < 2) {
+            scan_range(text, len, 0, starts, matches);
+        } else {
+            size_t chunk_len = (starts + chunks - 1) / chunks;
+            std::vector<std::vector<PatternMatch>> parts(chunks);
+            pool.parallel_for(chunks, [&](size_t i) {
+                size_t begin = i * chunk_len;
+                size_t end = std::min(starts, begin + chunk_len);
+                if (begin < end)
+                    scan_range(text, len, begin, end, parts[i]);
+            });
+            for (auto &part : parts)
+                matches.insert(matches.end(), part.begin(), part.end());
+        }
+        std::sort(matches.begin(), matches.end());
+        return matches;
+    }
+
+    std::vector<PatternMatch> search(std::string_view text) {
+        return search(text.data(), text.size());
+    }
+};
+
+#endif // PATTERN_SEARCH_H
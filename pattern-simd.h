@@ -0,0 +1,353 @@
+#ifndef PATTERN_SIMD_H
+#define PATTERN_SIMD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__)
+#define PATTERN_X86_64 1
+#include <immintrin.h>
+#endif
+
+// Vectorised kernels for H(w) = sum (i+1) * Len(w_i) mod 2^64.
+//
+// Len('*') is the all-ones word, which is -1 modulo the accumulator width, so
+//     Len(c) = 1 + D(c),   D('&') = 1, D('*') = -2, D(other) = 0
+// and H(w) = n(n+1)/2 + sum (i+1) * D(w_i). The kernels below only have to
+// produce the D-weighted sum, which fits comfortably in 8/16/32-bit lanes.
+// The 32-bit hash is the low half of the 64-bit one for the same reason.
+//
+// Each kernel also returns LenSum(w) = n + sum D(w_i), which is what the
+// split-and-combine paths need to stitch independent segments together.
+
+struct PatternSum {
+    uint64_t hash;
+    uint64_t len_sum;
+};
+
+// n(n+1)/2 mod 2^64 without losing the carry of the division.
+inline uint64_t pattern_triangular(uint64_t n) {
+    return (n & 1) ? n * ((n + 1) / 2) : (n / 2) * (n + 1);
+}
+
+inline int64_t pattern_delta(unsigned char c) {
+    return c == '&' ? 1 : (c == '*' ? -2 : 0);
+}
+
+// Portable fallback; also handles the tails of the vector kernels.
+// Adds the weighted deltas of str[begin, end) and their plain sum into `out`.
+inline void pattern_delta_sum(const char* str, size_t begin, size_t end, PatternSum& out) {
+    for (size_t i = begin; i < end; ++i) {
+        uint64_t d = static_cast<uint64_t>(pattern_delta(static_cast<unsigned char>(str[i])));
+        out.hash += (i + 1) * d;
+        out.len_sum += d;
+    }
+}
+
+inline PatternSum pattern_finish(PatternSum deltas, size_t len) {
+    return {pattern_triangular(len) + deltas.hash, len + deltas.len_sum};
+}
+
+inline PatternSum pattern_sum_scalar(const char* str, size_t len) {
+    PatternSum deltas{0, 0};
+    pattern_delta_sum(str, 0, len, deltas);
+    return pattern_finish(deltas, len);
+}
+
+inline uint64_t hash_kernel_scalar(const char* str, size_t len) {
+    return pattern_sum_scalar(str, len).hash;
+}
+
+#ifdef PATTERN_X86_64
+
+// Blocks per chunk before the 32-bit lane accumulators are folded into 64 bits.
+// The running prefix accumulator grows quadratically: 8 * 4096^2 / 2 < 2^31.
+constexpr size_t kPatternChunkBlocks = 4096;
+
+alignas(64) inline constexpr uint8_t kPatternWeights[64] = {
+     1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+    33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48,
+    49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64
+};
+
+// Adds `blocks` blocks of `width` bytes starting at byte `base` into `out`.
+// Lanes give, summed over blocks b: sum_d = sum S_b, pre = sum (blocks-1-b) S_b
+// and weighted = sum of in-block weighted deltas, so sum b*S_b = (blocks-1)*sum_d - pre.
+inline void pattern_fold_chunk(size_t base, size_t width, size_t blocks,
+                               int64_t sum_d, int64_t pre, int64_t weighted, PatternSum& out) {
+    uint64_t s = static_cast<uint64_t>(sum_d);
+    uint64_t block_term = (blocks - 1) * s - static_cast<uint64_t>(pre);
+    out.hash += base * s + width * block_term + static_cast<uint64_t>(weighted);
+    out.len_sum += s;
+}
+
+__attribute__((target("sse2")))
+inline int64_t pattern_hsum_sse2(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<int32_t>(_mm_cvtsi128_si32(v));
+}
+
+__attribute__((target("sse2")))
+inline PatternSum pattern_sum_sse2(const char* str, size_t len) {
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i w_lo = _mm_setr_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+    const __m128i w_hi = _mm_setr_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+    PatternSum deltas{0, 0};
+    size_t i = 0;
+    while (len - i >= 16) {
+        size_t blocks = (len - i) / 16;
+        if (blocks > kPatternChunkBlocks) blocks = kPatternChunkBlocks;
+        __m128i run = zero, pre = zero, weighted = zero;
+        for (size_t b = 0; b < blocks; ++b) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i + b * 16));
+            __m128i is_star = _mm_cmpeq_epi8(v, star);
+            // compare masks are -1, so D = 2*(-star) - (-amp) with signs flipped back
+            __m128i d = _mm_sub_epi8(_mm_add_epi8(is_star, is_star), _mm_cmpeq_epi8(v, amp));
+            __m128i sign = _mm_cmpgt_epi8(zero, d);
+            __m128i lo = _mm_unpacklo_epi8(d, sign);
+            __m128i hi = _mm_unpackhi_epi8(d, sign);
+            pre = _mm_add_epi32(pre, run);
+            run = _mm_add_epi32(run, _mm_madd_epi16(_mm_add_epi16(lo, hi), ones));
+            weighted = _mm_add_epi32(weighted, _mm_add_epi32(_mm_madd_epi16(lo, w_lo),
+                                                             _mm_madd_epi16(hi, w_hi)));
+        }
+        pattern_fold_chunk(i, 16, blocks, pattern_hsum_sse2(run),
+                           pattern_hsum_sse2(pre), pattern_hsum_sse2(weighted), deltas);
+        i += blocks * 16;
+    }
+    pattern_delta_sum(str, i, len, deltas);
+    return pattern_finish(deltas, len);
+}
+
+__attribute__((target("sse2")))
+inline uint64_t hash_kernel_sse2(const char* str, size_t len) {
+    return pattern_sum_sse2(str, len).hash;
+}
+
+__attribute__((target("avx2")))
+inline int64_t pattern_hsum_avx2(__m256i v) {
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<int32_t>(_mm_cvtsi128_si32(x));
+}
+
+__attribute__((target("avx2")))
+inline PatternSum pattern_sum_avx2(const char* str, size_t len) {
+    const __m256i amp = _mm256_set1_epi8('&');
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i ones8 = _mm256_set1_epi8(1);
+    const __m256i ones16 = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_load_si256(reinterpret_cast<const __m256i*>(kPatternWeights));
+    PatternSum deltas{0, 0};
+    size_t i = 0;
+    while (len - i >= 32) {
+        size_t blocks = (len - i) / 32;
+        if (blocks > kPatternChunkBlocks) blocks = kPatternChunkBlocks;
+        __m256i run = _mm256_setzero_si256(), pre = run, weighted = run;
+        for (size_t b = 0; b < blocks; ++b) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i + b * 32));
+            __m256i is_star = _mm256_cmpeq_epi8(v, star);
+            __m256i d = _mm256_sub_epi8(_mm256_add_epi8(is_star, is_star), _mm256_cmpeq_epi8(v, amp));
+            // maddubs: unsigned weights x signed deltas, pairwise into int16
+            __m256i s = _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, d), ones16);
+            __m256i w = _mm256_madd_epi16(_mm256_maddubs_epi16(weights, d), ones16);
+            pre = _mm256_add_epi32(pre, run);
+            run = _mm256_add_epi32(run, s);
+            weighted = _mm256_add_epi32(weighted, w);
+        }
+        pattern_fold_chunk(i, 32, blocks, pattern_hsum_avx2(run),
+                           pattern_hsum_avx2(pre), pattern_hsum_avx2(weighted), deltas);
+        i += blocks * 32;
+    }
+    pattern_delta_sum(str, i, len, deltas);
+    return pattern_finish(deltas, len);
+}
+
+__attribute__((target("avx2")))
+inline uint64_t hash_kernel_avx2(const char* str, size_t len) {
+    return pattern_sum_avx2(str, len).hash;
+}
+
+// Folded once per chunk, so a spill is cheaper than a shuffle tree here.
+__attribute__((target("avx512f")))
+inline int64_t pattern_hsum_avx512(__m512i v) {
+    alignas(64) int32_t lanes[16];
+    _mm512_store_si512(lanes, v);
+    int64_t sum = 0;
+    for (int32_t lane : lanes)
+        sum += lane;
+    return sum;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline PatternSum pattern_sum_avx512(const char* str, size_t len) {
+    const __m512i amp = _mm512_set1_epi8('&');
+    const __m512i star = _mm512_set1_epi8('*');
+    const __m512i plus1 = _mm512_set1_epi8(1);
+    const __m512i minus2 = _mm512_set1_epi8(-2);
+    const __m512i ones16 = _mm512_set1_epi16(1);
+    const __m512i weights = _mm512_load_si512(kPatternWeights);
+    PatternSum deltas{0, 0};
+    size_t i = 0;
+    while (len - i >= 64) {
+        size_t blocks = (len - i) / 64;
+        if (blocks > kPatternChunkBlocks) blocks = kPatternChunkBlocks;
+        __m512i run = _mm512_setzero_si512(), pre = run, weighted = run;
+        for (size_t b = 0; b < blocks; ++b) {
+            __m512i v = _mm512_loadu_si512(str + i + b * 64);
+            __m512i d = _mm512_maskz_mov_epi8(_mm512_cmpeq_epi8_mask(v, amp), plus1);
+            d = _mm512_mask_mov_epi8(d, _mm512_cmpeq_epi8_mask(v, star), minus2);
+            __m512i s = _mm512_madd_epi16(_mm512_maddubs_epi16(plus1, d), ones16);
+            __m512i w = _mm512_madd_epi16(_mm512_maddubs_epi16(weights, d), ones16);
+            pre = _mm512_add_epi32(pre, run);
+            run = _mm512_add_epi32(run, s);
+            weighted = _mm512_add_epi32(weighted, w);
+        }
+        pattern_fold_chunk(i, 64, blocks, pattern_hsum_avx512(run),
+                           pattern_hsum_avx512(pre), pattern_hsum_avx512(weighted), deltas);
+        i += blocks * 64;
+    }
+    pattern_delta_sum(str, i, len, deltas);
+    return pattern_finish(deltas, len);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline uint64_t hash_kernel_avx512(const char* str, size_t len) {
+    return pattern_sum_avx512(str, len).hash;
+}
+
+// Multi-buffer kernels: many short keys at once. A key of up to 64 bytes is
+// loaded whole with the bytes past its end masked to zero (D = 0 there), and
+// its weighted deltas are reduced to eight 32-bit partial sums. Eight keys'
+// partials are then summed across with one hadd tree, so the per-key cost is
+// a few vector ops and no loop or tail branch. Longer keys are left to the
+// single-buffer kernel (`long_kernel`).
+constexpr size_t kPatternManyLanes = 8;
+constexpr size_t kPatternManyMaxLen = 64;
+
+// Sums each of v[0..7] horizontally; lane k of the result is the sum of v[k].
+__attribute__((target("avx2")))
+inline __m256i pattern_transpose_sum_avx2(const __m256i v[8]) {
+    __m256i h0 = _mm256_hadd_epi32(v[0], v[1]);
+    __m256i h1 = _mm256_hadd_epi32(v[2], v[3]);
+    __m256i h2 = _mm256_hadd_epi32(v[4], v[5]);
+    __m256i h3 = _mm256_hadd_epi32(v[6], v[7]);
+    __m256i g0 = _mm256_hadd_epi32(h0, h1); // per 128-bit half: keys 0..3
+    __m256i g1 = _mm256_hadd_epi32(h2, h3); // per 128-bit half: keys 4..7
+    return _mm256_add_epi32(_mm256_permute2x128_si256(g0, g1, 0x20),
+                            _mm256_permute2x128_si256(g0, g1, 0x31));
+}
+
+// Adds the triangular term to each key's summed deltas; oversized keys go to long_kernel.
+inline void pattern_many_finish(const std::string_view* keys, size_t count, const int32_t sums[8],
+                                uint64_t (*long_kernel)(const char*, size_t), uint64_t* out) {
+    for (size_t k = 0; k < count; ++k) {
+        size_t n = keys[k].size();
+        out[k] = n > kPatternManyMaxLen
+            ? long_kernel(keys[k].data(), n)
+            : pattern_triangular(n) + static_cast<uint64_t>(static_cast<int64_t>(sums[k]));
+    }
+}
+
+// Up to 32 bytes of p with lanes [n, 32) zeroed. The whole-vector load stays
+// inside p's page, so it cannot fault even where it runs past the key; keys
+// too close to a page end are copied out instead.
+__attribute__((target("avx2"), no_sanitize("address")))
+inline __m256i pattern_load_masked_avx2(const char* p, size_t n) {
+    const __m256i index = _mm256_setr_epi8( 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+                                           16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    if (n == 0)
+        return _mm256_setzero_si256();
+    __m256i v;
+    if ((reinterpret_cast<uintptr_t>(p) & 4095) <= 4096 - 32) {
+        v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    } else {
+        alignas(32) char buf[32] = {};
+        std::memcpy(buf, p, n);
+        v = _mm256_load_si256(reinterpret_cast<const __m256i*>(buf));
+    }
+    return _mm256_and_si256(v, _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(n)), index));
+}
+
+// Eight int32 partial sums of the weighted deltas of a key of at most 64 bytes.
+__attribute__((target("avx2")))
+inline __m256i pattern_partial_avx2(std::string_view key) {
+    const __m256i amp = _mm256_set1_epi8('&');
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i ones16 = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    size_t n = key.size();
+    if (n > kPatternManyMaxLen)
+        return sum;
+    for (size_t half = 0; half * 32 < n; ++half) {
+        __m256i v = pattern_load_masked_avx2(key.data() + half * 32, std::min<size_t>(n - half * 32, 32));
+        __m256i is_star = _mm256_cmpeq_epi8(v, star);
+        __m256i d = _mm256_sub_epi8(_mm256_add_epi8(is_star, is_star), _mm256_cmpeq_epi8(v, amp));
+        __m256i weights = _mm256_load_si256(reinterpret_cast<const __m256i*>(kPatternWeights + half * 32));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(weights, d), ones16));
+    }
+    return sum;
+}
+
+__attribute__((target("avx2")))
+inline void hash_many_avx2(const std::string_view* keys, size_t count, uint64_t* out) {
+    for (size_t base = 0; base < count; base += kPatternManyLanes) {
+        size_t n = std::min(kPatternManyLanes, count - base);
+        __m256i partial[8];
+        for (size_t k = 0; k < 8; ++k)
+            partial[k] = k < n ? pattern_partial_avx2(keys[base + k]) : _mm256_setzero_si256();
+        alignas(32) int32_t sums[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(sums), pattern_transpose_sum_avx2(partial));
+        pattern_many_finish(keys + base, n, sums, hash_kernel_avx2, out + base);
+    }
+}
+
+// AVX-512 masked loads suppress faults on the masked-off bytes, so each key
+// is one 64-byte load with no page check.
+__attribute__((target("avx512f,avx512bw,avx2")))
+inline __m256i pattern_partial_avx512(std::string_view key) {
+    const __m512i amp = _mm512_set1_epi8('&');
+    const __m512i star = _mm512_set1_epi8('*');
+    const __m512i plus1 = _mm512_set1_epi8(1);
+    const __m512i minus2 = _mm512_set1_epi8(-2);
+    const __m512i ones16 = _mm512_set1_epi16(1);
+    size_t n = key.size();
+    if (n > kPatternManyMaxLen)
+        return _mm256_setzero_si256();
+    __mmask64 live = n == 64 ? ~__mmask64(0) : (__mmask64(1) << n) - 1;
+    __m512i v = _mm512_maskz_loadu_epi8(live, key.data());
+    __m512i d = _mm512_maskz_mov_epi8(_mm512_cmpeq_epi8_mask(v, amp), plus1);
+    d = _mm512_mask_mov_epi8(d, _mm512_cmpeq_epi8_mask(v, star), minus2);
+    __m512i w = _mm512_madd_epi16(_mm512_maddubs_epi16(_mm512_load_si512(kPatternWeights), d), ones16);
+    // Folded to 256 bits through memory: GCC 12's 512->256 extract intrinsics
+    // trip -Wmaybe-uninitialized on their own placeholder operand.
+    __m256i halves[2];
+    std::memcpy(halves, &w, sizeof(w));
+    return _mm256_add_epi32(halves[0], halves[1]);
+}
+
+__attribute__((target("avx512f,avx512bw,avx2")))
+inline void hash_many_avx512(const std::string_view* keys, size_t count, uint64_t* out) {
+    for (size_t base = 0; base < count; base += kPatternManyLanes) {
+        size_t n = std::min(kPatternManyLanes, count - base);
+        __m256i partial[8];
+        for (size_t k = 0; k < 8; ++k)
+            partial[k] = k < n ? pattern_partial_avx512(keys[base + k]) : _mm256_setzero_si256();
+        alignas(32) int32_t sums[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(sums), pattern_transpose_sum_avx2(partial));
+        pattern_many_finish(keys + base, n, sums, hash_kernel_avx512, out + base);
+    }
+}
+
+#endif // PATTERN_X86_64
+
+#endif // PATTERN_SIMD_H
@@ -0,0 +1,105 @@
+#ifndef PATTERN_STREAM_H
+#define PATTERN_STREAM_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "pattern.h"
+
+// Incremental form of hash_function_32/64 for data that arrives in pieces.
+// The state is the PatternSegment of everything seen so far, so update() costs
+// one kernel pass over the new bytes and combine() is O(1).
+class PatternHasher {
+private:
+    PatternSegment state;
+
+public:
+    PatternHasher& update(const char* data, size_t len) {
+        state.append(pattern_segment(data, len));
+        return *this;
+    }
+
+    PatternHasher& update(std::string_view data) {
+        return update(data.data(), data.size());
+    }
+
+    // Appends a hasher that saw the bytes following ours (e.g. on another thread).
+    PatternHasher& combine(const PatternHasher& other) {
+        state.append(other.state);
+        return *this;
+    }
+
+    uint64_t finalize() const { return state.hash; }
+    uint32_t finalize32() const { return static_cast<uint32_t>(state.hash); }
+
+    const PatternSegment& segment() const { return state; }
+    uint64_t length() const { return state.length; }
+    void reset() { state = PatternSegment(); }
+};
+
+// Hash of the last `width` bytes, updated in O(1) per byte. Sliding the window
+// one byte drops every position weight by one, i.e. subtracts LenSum:
+//     H' = H - LenSum + width * Len(in),   LenSum' = LenSum - Len(out) + Len(in)
+class PatternRollingHasher {
+private:
+    std::vector<unsigned char> window; // ring buffer of the current window
+    size_t width;
+    size_t head = 0;
+    size_t filled = 0;
+    uint64_t hash = 0;
+    uint64_t len_sum = 0;
+
+public:
+    explicit PatternRollingHasher(size_t width) : window(width), width(width) {}
+
+    // Adds one byte; once the window is full the oldest byte drops out.
+    void push(char c) {
+        unsigned char in = static_cast<unsigned char>(c);
+        if (filled < width) {
+            ++filled;
+            hash += filled * pattern_len_64(in);
+            len_sum += pattern_len_64(in);
+        } else if (width > 0) {
+            roll(static_cast<char>(window[head]), c);
+        }
+        if (width > 0) {
+            window[head] = in;
+            head = head + 1 == width ? 0 : head + 1;
+        }
+    }
+
+    void push(const char* data, size_t len) {
+        for (size_t i = 0; i < len; ++i)
+            push(data[i]);
+    }
+
+    // Slides a full window without touching the ring buffer, for callers that
+    // still hold the outgoing byte (e.g. scanning a contiguous buffer).
+    void roll(char out, char in) {
+        uint64_t len_in = pattern_len_64(static_cast<unsigned char>(in));
+        hash = hash - len_sum + width * len_in;
+        len_sum = len_sum - pattern_len_64(static_cast<unsigned char>(out)) + len_in;
+    }
+
+    // Starts the window over str[0, width) in one kernel pass.
+    void assign(const char* str) {
+        PatternSegment seg = pattern_segment(str, width);
+        hash = seg.hash;
+        len_sum = seg.len_sum;
+        filled = width;
+        head = 0;
+        for (size_t i = 0; i < width; ++i)
+            window[i] = static_cast<unsigned char>(str[i]);
+    }
+
+    bool full() const { return filled == width; }
+    uint64_t value() const { return hash; }
+    uint32_t value32() const { return static_cast<uint32_t>(hash); }
+
+    void reset() {
+        head = filled = 0;
+        hash = len_sum = 0;
+    }
+};
+
+#endif // PATTERN_STREAM_H
@@ -0,0 +1,80 @@
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+
+#include "pattern.h"
+#include "pattern-stream.h"
+#include "pattern-substitution.h"
+
+int main() {
+    std::mt19937 gen(42);
+    const char symbols[] = {'*', '&', '1', 'x'};
+
+    // 1. The sequence from the paper: s_0 = *, s_{n+1} = σ(s_n) with σ(*) = &1.
+    std::cout << "\n1. First Iterates:" << std::endl;
+    PatternSubstitution sigma;
+    for (uint64_t n = 0; n <= 5; ++n) {
+        PatternIterate s(sigma, "*", n);
+        std::cout << "s_" << n << " = " << s.str() << "  (length " << s.length() << ", hash " << s.hash()
+                  << ", Len-hat " << (s.infinite_len() ? "inf" : std::to_string(s.len_sum())) << ")" << std::endl;
+    }
+
+    // 2. Compact form against step-by-step expansion, for random seeds and rules.
+    std::cout << "\n2. Expansion Comparison Test:" << std::endl;
+    size_t checked = 0, mismatches = 0;
+    for (size_t trial = 0; trial < 200; ++trial) {
+        PatternSubstitution rules(trial % 2 ? "&1" : "1");
+        if (trial % 3 == 0) { // growing rules as well
+            std::string image(1 + gen() % 3, ' ');
+            for (char &c : image)
+                c = symbols[gen() % 4];
+            rules.set_rule('x', image);
+        }
+        if (trial % 5 == 1) // cycles with an empty tail
+            rules.set_rule('&', "*");
+        std::string word(1 + gen() % 12, ' ');
+        for (char &c : word)
+            c = "*&1x?a"[gen() % 6];
+        std::string expanded = word;
+        for (uint64_t n = 0; n <= 150 && expanded.size() < 200000; ++n, expanded = rules.apply(expanded)) {
+            PatternIterate it(rules, word, n);
+            PatternHasher streamed;
+            it.expand([&streamed](const char* data, size_t len) { streamed.update(data, len); }, UINT64_MAX, 7);
+            bool ok = it.hash() == hash_function_64(expanded.data(), expanded.size()) &&
+                      it.length() == expanded.size() && streamed.finalize() == it.hash() &&
+                      it.len_sum() == pattern_segment(expanded.data(), expanded.size()).len_sum &&
+                      it.count('*') == static_cast<uint64_t>(std::count(expanded.begin(), expanded.end(), '*'));
+            mismatches += !ok;
+            ++checked;
+        }
+    }
+    std::cout << checked << " iterates checked, " << mismatches << " mismatches" << std::endl;
+
+    // 3. Deep iterates: nothing is expanded, so n is only limited by uint64_t.
+    std::cout << "\n3. Deep Iterates:" << std::endl;
+    std::string seed = "*&1x*&&1*";
+    for (uint64_t n : {uint64_t(1000), uint64_t(1000000000), uint64_t(1000000000000000000)}) {
+        auto start = std::chrono::steady_clock::now();
+        PatternIterate deep(sigma, seed, n);
+        uint64_t hash = deep.hash();
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "sigma^" << n << "(" << seed << "): length " << deep.length() << ", hash " << hash
+                  << ", '*' count " << deep.count('*') << " (" << elapsed.count() << " us)" << std::endl;
+    }
+
+    // 4. Streaming a deep iterate: the whole of sigma^10^7 and a prefix of sigma^10^18.
+    std::cout << "\n4. Streaming Expansion:" << std::endl;
+    PatternIterate big(sigma, seed, 10000000);
+    PatternHasher streamed;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = big.expand([&streamed](const char* data, size_t len) { streamed.update(data, len); });
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Streamed " << bytes << " bytes in " << elapsed.count() << " ms, hash "
+              << (streamed.finalize() == big.hash() ? "matches" : "MISMATCH") << std::endl;
+    std::cout << "Prefix of sigma^10^18: " << PatternIterate(sigma, seed, 1000000000000000000).str(40) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+#ifndef PATTERN_SUBSTITUTION_H
+#define PATTERN_SUBSTITUTION_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "pattern.h"
+
+// The substitution system of pattern-learning.tex:
+//     σ(*) = 1 | &1,   σ(&) = *1,   σ(1) = 1,   σ(x) = x
+// applied to every symbol of a word at once, s_{n+1} = σ(s_n). The choice for
+// '*' is fixed per PatternSubstitution (the paper's proof uses "&1"). Any byte
+// may be given a rule, and a byte without one maps to itself.
+class PatternSubstitution {
+private:
+    std::array<std::string, 256> images;
+    std::array<bool, 256> identity;
+
+public:
+    explicit PatternSubstitution(std::string_view star = "&1") {
+        for (size_t c = 0; c < 256; ++c) {
+            images[c] = std::string(1, static_cast<char>(c));
+            identity[c] = true;
+        }
+        set_rule('*', star);
+        set_rule('&', "*1");
+    }
+
+    void set_rule(char c, std::string_view image) {
+        unsigned char u = static_cast<unsigned char>(c);
+        images[u] = std::string(image);
+        identity[u] = image.size() == 1 && image[0] == c;
+    }
+
+    const std::string& image(char c) const { return images[static_cast<unsigned char>(c)]; }
+    bool fixed(char c) const { return identity[static_cast<unsigned char>(c)]; }
+
+    // One step, fully expanded; the reference the compact form is checked against.
+    std::string apply(std::string_view word) const {
+        std::string out;
+        for (char c : word)
+            out += image(c);
+        return out;
+    }
+};
+
+// σ^n(seed) without expanding it. The hash, Len-hat and length of a word are
+// determined by how many times each symbol occurs and how many times each
+// ordered pair of symbols occurs (d before e, anywhere):
+//     H(w) = sum_e Len(e) N[e] + sum_{d,e} Q[d][e] Len(e)
+// and both tables of σ^a(w) follow from those of w and of σ^a(d) for each
+// symbol d. σ^n is built from the tables of σ by repeated squaring. The cost
+// is O(A^4 log n) for A symbols in play, and never depends on the length of
+// the iterate. Every quantity is modulo 2^64 like the hash itself, so
+// length() is exact only while the iterate is shorter than 2^64 bytes.
+//
+// Symbols in play are those with a rule reachable from the seed, plus the
+// bytes their images produce. Fixed bytes that occur only in the seed
+// never move and are folded into one stand-in per Len value.
+class PatternIterate {
+private:
+    // Counts and ordered pair counts of one word over the A symbols in play.
+    struct Profile {
+        std::vector<uint64_t> count;  // A
+        std::vector<uint64_t> pairs;  // A*A, pairs[d*A+e] = #{i<j : w_i = d, w_j = e}
+    };
+    using Map = std::vector<Profile>; // profile of σ^k(d) for each symbol d
+
+    const PatternSubstitution* rules;
+    std::string seed;
+    uint64_t steps;
+    size_t symbols = 0;                     // A
+    std::vector<uint64_t> lens;             // Len of each symbol
+    std::array<int, 256> index;             // symbol of each byte in play, or -1
+    std::array<uint64_t, 256> seed_only{};  // occurrences of folded seed bytes
+    size_t seed_fixed_from = 0;             // seed[i] is fixed for every i >= this
+    Profile result;
+
+    Profile empty() const { return {std::vector<uint64_t>(symbols, 0), std::vector<uint64_t>(symbols * symbols, 0)}; }
+
+    Profile profile_of(std::string_view word, const std::array<int, 256> &symbol_of) const {
+        Profile p = empty();
+        for (char c : word) {
+            size_t e = static_cast<size_t>(symbol_of[static_cast<unsigned char>(c)]);
+            for (size_t d = 0; d < symbols; ++d)
+                p.pairs[d * symbols + e] += p.count[d];
+            ++p.count[e];
+        }
+        return p;
+    }
+
+    // Profile of σ^k(w) from the profile of w and the map of σ^k.
+    Profile apply(const Map &m, const Profile &w) const {
+        size_t a = symbols;
+        Profile out = empty();
+        std::vector<uint64_t> y(a * a, 0); // y[d][f] = sum_d' pairs[d][d'] count_k(d')[f]
+        for (size_t d = 0; d < a; ++d) {
+            if (w.count[d] != 0) {
+                for (size_t e = 0; e < a; ++e)
+                    out.count[e] += w.count[d] * m[d].count[e];
+                for (size_t ef = 0; ef < a * a; ++ef)
+                    out.pairs[ef] += w.count[d] * m[d].pairs[ef];
+            }
+            for (size_t d2 = 0; d2 < a; ++d2) {
+                uint64_t q = w.pairs[d * a + d2];
+                if (q != 0)
+                    for (size_t f = 0; f < a; ++f)
+                        y[d * a + f] += q * m[d2].count[f];
+            }
+        }
+        // Pairs split across two source symbols: d before d' puts every e
+        // of σ^k(d) before every f of σ^k(d').
+        for (size_t d = 0; d < a; ++d)
+            for (size_t e = 0; e < a; ++e)
+                if (uint64_t c = m[d].count[e])
+                    for (size_t f = 0; f < a; ++f)
+                        out.pairs[e * a + f] += c * y[d * a + f];
+        return out;
+    }
+
+    Map compose(const Map &outer, const Map &inner) const {
+        Map out;
+        out.reserve(symbols);
+        for (const Profile &p : inner)
+            out.push_back(apply(outer, p));
+        return out;
+    }
+
+    void build() {
+        index.fill(-1);
+        std::vector<char> bytes;   // byte of each real symbol
+        auto add = [&](unsigned char c) {
+            if (index[c] < 0) {
+                index[c] = static_cast<int>(bytes.size());
+                bytes.push_back(static_cast<char>(c));
+            }
+        };
+        for (size_t i = 0; i < seed.size(); ++i) {
+            if (!rules->fixed(seed[i])) {
+                add(static_cast<unsigned char>(seed[i]));
+                seed_fixed_from = i + 1;
+            }
+        }
+        for (size_t i = 0; i < bytes.size(); ++i)   // closure over the images
+            if (!rules->fixed(bytes[i]))
+                for (char c : rules->image(bytes[i]))
+                    add(static_cast<unsigned char>(c));
+        size_t real = bytes.size();
+        // One stand-in per Len value for fixed bytes seen only in the seed.
+        std::array<int, 256> symbol_of = index;
+        std::vector<uint64_t> stand_in_lens;
+        for (char c : seed) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (index[u] >= 0)
+                continue;
+            ++seed_only[u];
+            uint64_t len = pattern_len_64(u);
+            size_t k = 0;
+            while (k < stand_in_lens.size() && stand_in_lens[k] != len)
+                ++k;
+            if (k == stand_in_lens.size())
+                stand_in_lens.push_back(len);
+            symbol_of[u] = static_cast<int>(real + k);
+        }
+        symbols = real + stand_in_lens.size();
+        for (char c : bytes)
+            lens.push_back(pattern_len_64(static_cast<unsigned char>(c)));
+        lens.insert(lens.end(), stand_in_lens.begin(), stand_in_lens.end());
+
+        Map power(symbols), acc(symbols);
+        for (size_t d = 0; d < symbols; ++d) {
+            acc[d] = empty();
+            acc[d].count[d] = 1;   // σ^0
+            power[d] = d < real && !rules->fixed(bytes[d]) ? profile_of(rules->image(bytes[d]), symbol_of) : acc[d];
+        }
+        for (uint64_t n = steps; n != 0; n >>= 1) {
+            if (n & 1)
+                acc = compose(power, acc);
+            if (n > 1)
+                power = compose(power, power);
+        }
+        result = apply(acc, profile_of(seed, symbol_of));
+    }
+
+    // Expansion state: `text` at `level` substitutions still to apply.
+    struct Frame {
+        std::string_view text;
+        size_t pos;
+        uint64_t level;     // 0 once the rest is all fixed
+        uint64_t repeat;    // text is emitted this many times (level 0 only)
+    };
+
+    static constexpr uint64_t kShortDescent = 64; // descents walked step by step
+
+    bool fixed_tail(std::string_view rest) const {
+        if (rest.data() + rest.size() == seed.data() + seed.size())
+            return seed.size() - rest.size() >= seed_fixed_from; // no rescan of a long seed
+        for (char c : rest)
+            if (!rules->fixed(c))
+                return false;
+        return true;
+    }
+
+    // Queues `times` copies of an all-fixed text, merging with an equal entry below.
+    static void push_fixed(std::vector<Frame> &stack, std::string_view text, uint64_t times) {
+        if (text.empty() || times == 0)
+            return;
+        Frame* below = stack.empty() ? nullptr : &stack.back();
+        if (below && below->pos == 0 && below->level == 0 && below->text == text)
+            below->repeat += times;
+        else
+            stack.push_back({text, 0, 0, times});
+    }
+
+    // σ^level(c) when each rule on c's leftmost chain c -> image(c)[0] -> ...
+    // has the same all-fixed tail T after its first byte: the chain's symbol j
+    // steps down followed by T^j. Queues that and returns true, or returns
+    // false if the chain does not have that shape.
+    bool jump_descent(std::vector<Frame> &stack, char c, uint64_t level) const {
+        static const auto bytes = [] {
+            std::array<char, 256> b{};
+            for (size_t i = 0; i < 256; ++i)
+                b[i] = static_cast<char>(i);
+            return b;
+        }();
+        std::array<int, 256> seen;
+        seen.fill(-1);
+        std::vector<char> chain;
+        std::string_view tail;
+        char d = c;
+        while (!rules->fixed(d) && seen[static_cast<unsigned char>(d)] < 0) {
+            const std::string &img = rules->image(d);
+            std::string_view t = img.empty() ? std::string_view() : std::string_view(img).substr(1);
+            if (img.empty() || (!chain.empty() && t != tail) || !fixed_tail(t))
+                return false;
+            tail = t;
+            seen[static_cast<unsigned char>(d)] = static_cast<int>(chain.size());
+            chain.push_back(d);
+            d = img[0];
+        }
+        uint64_t steps_down = level;
+        char last;
+        if (rules->fixed(d) && level >= chain.size()) {
+            steps_down = chain.size();  // bottoms out in a fixed byte
+            last = d;
+        } else if (level < chain.size()) {
+            last = chain[level];
+        } else {
+            uint64_t mu = static_cast<uint64_t>(seen[static_cast<unsigned char>(d)]);
+            last = chain[mu + (level - mu) % (chain.size() - mu)];
+        }
+        push_fixed(stack, tail, steps_down);
+        stack.push_back({std::string_view(&bytes[static_cast<unsigned char>(last)], 1), 0, 0, 1});
+        return true;
+    }
+
+public:
+    PatternIterate(const PatternSubstitution &rules, std::string_view seed, uint64_t n)
+        : rules(&rules), seed(seed), steps(n) {
+        build();
+    }
+
+    uint64_t iterations() const { return steps; }
+
+    uint64_t length() const {
+        uint64_t n = 0;
+        for (uint64_t c : result.count)
+            n += c;
+        return n;
+    }
+
+    // Len-hat with Len('*') as the all-ones word, as the hash kernels use it.
+    uint64_t len_sum() const {
+        uint64_t s = 0;
+        for (size_t e = 0; e < symbols; ++e)
+            s += lens[e] * result.count[e];
+        return s;
+    }
+
+    // Equal to hash_function_64 of the expanded iterate.
+    uint64_t hash() const {
+        uint64_t h = len_sum();
+        for (size_t d = 0; d < symbols; ++d)
+            for (size_t e = 0; e < symbols; ++e)
+                h += result.pairs[d * symbols + e] * lens[e];
+        return h;
+    }
+
+    uint32_t hash32() const { return static_cast<uint32_t>(hash()); }
+
+    PatternSegment segment() const { return {hash(), len_sum(), length()}; }
+
+    // Occurrences of c in the iterate.
+    uint64_t count(char c) const {
+        unsigned char u = static_cast<unsigned char>(c);
+        return index[u] >= 0 ? result.count[static_cast<size_t>(index[u])] : seed_only[u];
+    }
+
+    // In the paper's extended reals Len(*) = ∞, so Len-hat is infinite
+    // whenever a '*' survives.
+    bool infinite_len() const { return count('*') != 0; }
+
+    // Streams up to `limit` bytes of the expanded iterate to
+    // sink(const char*, size_t) in chunks of `chunk` bytes and returns the
+    // number written. It walks the derivation tree depth first. A pending
+    // tail made only of fixed bytes comes out the same whatever its level,
+    // so equal tails share one stack entry with a repeat count. A deep
+    // leftmost descent that cycles through rules leaving the same fixed tail
+    // at every step is taken in one jump. So σ^n(*) = (*|&)1^n needs O(1)
+    // stack, and its first byte costs O(1) even for n = 10^18.
+    template<typename Sink>
+    uint64_t expand(Sink &&sink, uint64_t limit = UINT64_MAX, size_t chunk = size_t(64) << 10) const {
+        std::vector<Frame> stack{{seed, 0, steps, 1}};
+        std::string buffer;
+        buffer.reserve(chunk);
+        uint64_t written = 0;
+        while (!stack.empty() && written < limit) {
+            Frame &f = stack.back();
+            if (f.pos == f.text.size()) {
+                if (--f.repeat == 0)
+                    stack.pop_back();
+                else
+                    f.pos = 0;
+                continue;
+            }
+            char c = f.text[f.pos++];
+            if (f.level == 0 || rules->fixed(c)) {
+                buffer += c;
+                ++written;
+                if (buffer.size() == chunk) {
+                    sink(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+                continue;
+            }
+            uint64_t level = f.level;
+            std::string_view rest = f.text.substr(f.pos);
+            if (f.repeat == 1 && fixed_tail(rest)) {
+                // The rest of this frame no longer depends on its level.
+                stack.pop_back();
+                push_fixed(stack, rest, 1);
+            }
+            if (level <= kShortDescent || !jump_descent(stack, c, level))
+                stack.push_back({rules->image(c), 0, level - 1, 1});
+        }
+        if (!buffer.empty())
+            sink(buffer.data(), buffer.size());
+        return written;
+    }
+
+    // The first `limit` bytes, expanded.
+    std::string str(uint64_t limit = UINT64_MAX) const {
+        std::string out;
+        expand([&out](const char* data, size_t len) { out.append(data, len); }, limit);
+        return out;
+    }
+};
+
+#endif // PATTERN_SUBSTITUTION_H
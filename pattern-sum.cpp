@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pattern.h"
+#include "pattern-file.h"
+#include "pattern-threadpool.h"
+
+// sha256sum-style digests with the pattern hash.
+//
+//     pattern-sum [--32] [-j N] FILE|DIR|- ...   print "<hex>  <path>" per file
+//     pattern-sum -c [--quiet] LIST ...          verify a list written by the above
+//
+// Directories are walked recursively in sorted order and no arguments means
+// stdin. Inputs are hashed by a bounded set of workers and printed in argument
+// order as they complete; files past kParallelHashThreshold are also split
+// across a shared pool. A digest's width (8 or 16 hex digits) picks the 32- or
+// 64-bit hash when verifying. Exit status is 1 if any input could not be read
+// or did not match, 2 on a usage error.
+
+struct SumJob {
+    std::string path;           // "-" is stdin
+    std::string expected;       // verify mode: the listed digest
+    std::string digest;
+    std::string error;
+    bool done = false;
+};
+
+struct SumConfig {
+    bool bits32 = false;
+    bool check = false;
+    bool quiet = false;         // verify mode: print only failures
+    size_t threads = 0;         // 0: hardware_concurrency
+};
+
+static std::string hex_digest(uint64_t hash, bool bits32) {
+    char out[17];
+    if (bits32)
+        std::snprintf(out, sizeof(out), "%08x", static_cast<uint32_t>(hash));
+    else
+        std::snprintf(out, sizeof(out), "%016llx", static_cast<unsigned long long>(hash));
+    return out;
+}
+
+// Files under a directory argument, sorted so the output is reproducible.
+static void add_inputs(const std::string &arg, std::vector<SumJob> &jobs) {
+    std::error_code ec;
+    if (arg != "-" && std::filesystem::is_directory(arg, ec)) {
+        std::vector<std::string> files;
+        auto options = std::filesystem::directory_options::skip_permission_denied;
+        for (auto it = std::filesystem::recursive_directory_iterator(arg, options, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            if (it->is_regular_file(ec))
+                files.push_back(it->path().string());
+        if (ec)
+            std::cerr << "pattern-sum: " << arg << ": " << ec.message() << std::endl;
+        std::sort(files.begin(), files.end());
+        for (auto &f : files)
+            jobs.push_back({std::move(f), "", "", "", false});
+        return;
+    }
+    jobs.push_back({arg, "", "", "", false});
+}
+
+// Reads "<hex>  <path>" lines (also "<hex> *<path>"); returns false if the list cannot be read.
+static bool add_checks(const std::string &list, std::vector<SumJob> &jobs, size_t &malformed) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (list != "-") {
+        file.open(list);
+        if (!file)
+            return false;
+        in = &file;
+    }
+    std::string line;
+    while (std::getline(*in, line)) {
+        size_t space = line.find(' ');
+        bool valid_width = space == 8 || space == 16;
+        if (!valid_width || line.size() < space + 3 || (line[space + 1] != ' ' && line[space + 1] != '*') ||
+            line.find_first_not_of("0123456789abcdefABCDEF") != space) {
+            if (!line.empty())
+                ++malformed;
+            continue;
+        }
+        jobs.push_back({line.substr(space + 2), line.substr(0, space), "", "", false});
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    SumConfig cfg;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--32") cfg.bits32 = true;
+        else if (arg == "--64") cfg.bits32 = false;
+        else if (arg == "-c" || arg == "--check") cfg.check = true;
+        else if (arg == "--quiet") cfg.quiet = true;
+        else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) cfg.threads = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--") { args.insert(args.end(), argv + i + 1, argv + argc); break; }
+        else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "usage: " << argv[0] << " [--32|--64] [-j N] [FILE|DIR|-]...\n"
+                      << "       " << argv[0] << " -c [--quiet] [-j N] [LIST|-]..." << std::endl;
+            return 2;
+        }
+        else args.push_back(arg);
+    }
+    if (args.empty())
+        args.push_back("-");
+    if (cfg.threads == 0)
+        cfg.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<SumJob> jobs;
+    size_t malformed = 0;
+    bool failed = false;
+    for (const std::string &arg : args) {
+        if (!cfg.check) {
+            add_inputs(arg, jobs);
+        } else if (!add_checks(arg, jobs, malformed)) {
+            std::cerr << "pattern-sum: " << arg << ": cannot open checksum list" << std::endl;
+            failed = true;
+        }
+    }
+
+    // Workers take the next job by index; whoever finishes the job at the
+    // print cursor prints every finished job from there on, so the output is
+    // in input order and streams out as the front of the list completes.
+    ThreadPool pool(cfg.threads);
+    std::atomic<size_t> next_job{0};
+    std::mutex print_mutex;
+    size_t print_cursor = 0;
+    size_t mismatches = 0, unreadable = 0;
+    auto print_ready = [&] {
+        for (; print_cursor < jobs.size() && jobs[print_cursor].done; ++print_cursor) {
+            SumJob &job = jobs[print_cursor];
+            if (!job.error.empty()) {
+                ++unreadable;
+                std::cerr << "pattern-sum: " << job.path << ": " << job.error << "\n";
+                if (cfg.check)
+                    std::cout << job.path << ": FAILED open or read\n";
+            } else if (!cfg.check) {
+                std::cout << job.digest << "  " << job.path << "\n";
+            } else if (job.digest != job.expected) {
+                ++mismatches;
+                std::cout << job.path << ": FAILED\n";
+            } else if (!cfg.quiet) {
+                std::cout << job.path << ": OK\n";
+            }
+        }
+    };
+    auto worker = [&] {
+        for (size_t i; (i = next_job.fetch_add(1, std::memory_order_relaxed)) < jobs.size();) {
+            SumJob &job = jobs[i];
+            bool bits32 = cfg.check ? job.expected.size() == 8 : cfg.bits32;
+            PatternFileHash result = job.path == "-" ? pattern_hash_fd(0, pool) : pattern_hash_file(job.path, pool);
+            std::transform(job.expected.begin(), job.expected.end(), job.expected.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (result.ok())
+                job.digest = hex_digest(result.hash(), bits32);
+            else
+                job.error = result.error;
+            std::lock_guard lock(print_mutex);
+            job.done = true;
+            print_ready();
+        }
+    };
+    // Plain threads rather than pool tasks: a worker blocks on the pool while
+    // it splits a large file, which a pool thread must not do.
+    std::vector<std::thread> workers;
+    size_t worker_count = std::min(cfg.threads, jobs.size());
+    for (size_t t = 1; t < worker_count; ++t)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &t : workers)
+        t.join();
+    std::cout.flush();
+
+    if (malformed)
+        std::cerr << "pattern-sum: WARNING: " << malformed << " line(s) are improperly formatted" << std::endl;
+    if (unreadable)
+        std::cerr << "pattern-sum: WARNING: " << unreadable << " file(s) could not be read" << std::endl;
+    if (mismatches)
+        std::cerr << "pattern-sum: WARNING: " << mismatches << " computed checksum(s) did NOT match" << std::endl;
+    return failed || unreadable || mismatches ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+#ifndef PATTERN_THREADPOOL_H
+#define PATTERN_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size worker pool. Tasks run in FIFO order; submit() returns a future.
+// Callers that block on their own tasks should do a share of the work on the
+// calling thread rather than waiting idle (see parallel_for).
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping = false;
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+        if (threads == 0) threads = 1;
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+            workers.emplace_back([this] { run(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto &t : workers)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    template<typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& f) {
+        using R = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace_back([task] { (*task)(); });
+        }
+        ready.notify_one();
+        return result;
+    }
+
+    // Runs fn(i) for i in [0, count): index 0 on the calling thread, the rest
+    // on the pool. Returns once all of them have finished.
+    template<typename F>
+    void parallel_for(size_t count, F&& fn) {
+        std::vector<std::future<void>> pending;
+        pending.reserve(count);
+        for (size_t i = 1; i < count; ++i)
+            pending.push_back(submit([&fn, i] { fn(i); }));
+        // Every task references fn, so all of them are drained before rethrowing.
+        std::exception_ptr error;
+        try {
+            if (count > 0)
+                fn(0);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        for (auto &f : pending) {
+            try {
+                f.get();
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Runs fn(i) for i in [0, count) on the calling thread and on whichever
+    // workers pick up a helper task before the indices run out. The caller
+    // never waits for a queued task, only for indices a worker has already
+    // claimed, so unlike parallel_for this is safe to call from a pool task:
+    // on a busy pool the caller just does all of it.
+    template<typename F>
+    void help_for(size_t count, F&& fn) {
+        struct Work {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::exception_ptr error;
+        };
+        auto work = std::make_shared<Work>();
+        // A helper touches fn only after claiming an index, and every claimed
+        // index is finished before the caller returns.
+        auto drain = [&fn](Work &w, size_t n) {
+            for (size_t i; (i = w.next.fetch_add(1, std::memory_order_relaxed)) < n;) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard lock(w.mutex);
+                    if (!w.error) w.error = std::current_exception();
+                }
+                w.done.fetch_add(1, std::memory_order_release);
+            }
+        };
+        for (size_t i = 1, helpers = std::min(size() + 1, count); i < helpers; ++i)
+            submit([work, drain, count] { drain(*work, count); });
+        drain(*work, count);
+        while (work->done.load(std::memory_order_acquire) < count)
+            std::this_thread::yield();
+        if (work->error)
+            std::rethrow_exception(work->error);
+    }
+
+    // Process-wide pool sized to the machine, created on first use.
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+};
+
+#endif // PATTERN_THREADPOOL_H
@@ -11,9 +11,17 @@
 #include <thread>
 #include <future>
 #include <string>
+#include <string_view>
+#include <span>
+#include <atomic>
+#include <cstdlib>
 
-// 32-bit hash function using inline assembly
-uint32_t hash_function_32(const char* str, size_t len) {
+#include "pattern-simd.h"
+
+#ifdef PATTERN_X86_64
+
+// 32-bit hash function using inline assembly (reference kernel)
+uint32_t hash_function_32_asm(const char* str, size_t len) {
     uint32_t hash;
     asm volatile (
         "xorq %%rax, %%rax\n"             // Clear 64-bit accumulator (rax)
@@ -57,8 +65,8 @@ uint32_t hash_function_32(const char* str, size_t len) {
     return hash;
 }
 
-// 64-bit hash function using inline assembly
-uint64_t hash_function_64(const char* str, size_t len) {
+// 64-bit hash function using inline assembly (reference kernel)
+uint64_t hash_function_64_asm(const char* str, size_t len) {
     uint64_t hash;
     asm volatile (
         "xorq %%rax, %%rax\n"             // Clear 64-bit accumulator (rax)
@@ -102,6 +110,172 @@ uint64_t hash_function_64(const char* str, size_t len) {
     return hash;
 }
 
+#endif // PATTERN_X86_64
+
+// Kernel selection. Auto picks the widest kernel the CPU supports; the
+// PATTERN_HASH_KERNEL environment variable (asm, scalar, sse2, avx2, avx512)
+// or pattern_set_kernel() force a specific one for A/B runs.
+enum class PatternKernel { Auto, Asm, Scalar, SSE2, AVX2, AVX512 };
+
+using pattern_kernel_fn = uint64_t (*)(const char*, size_t);
+using pattern_sum_fn = PatternSum (*)(const char*, size_t);
+
+inline const char* pattern_kernel_name(PatternKernel kernel) {
+    switch (kernel) {
+    case PatternKernel::Asm:    return "asm";
+    case PatternKernel::Scalar: return "scalar";
+    case PatternKernel::SSE2:   return "sse2";
+    case PatternKernel::AVX2:   return "avx2";
+    case PatternKernel::AVX512: return "avx512";
+    default:                    return "auto";
+    }
+}
+
+inline bool pattern_kernel_supported(PatternKernel kernel) {
+    switch (kernel) {
+    case PatternKernel::Auto:
+    case PatternKernel::Scalar:
+        return true;
+#ifdef PATTERN_X86_64
+    case PatternKernel::Asm:
+    case PatternKernel::SSE2:
+        return true;
+    case PatternKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case PatternKernel::AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    default:
+        return false;
+    }
+}
+
+inline PatternKernel pattern_best_kernel() {
+    for (PatternKernel k : {PatternKernel::AVX512, PatternKernel::AVX2, PatternKernel::SSE2})
+        if (pattern_kernel_supported(k))
+            return k;
+    return PatternKernel::Scalar;
+}
+
+inline pattern_kernel_fn pattern_kernel_function(PatternKernel kernel) {
+    switch (kernel) {
+#ifdef PATTERN_X86_64
+    case PatternKernel::Asm:    return hash_function_64_asm;
+    case PatternKernel::SSE2:   return hash_kernel_sse2;
+    case PatternKernel::AVX2:   return hash_kernel_avx2;
+    case PatternKernel::AVX512: return hash_kernel_avx512;
+#endif
+    default:                    return hash_kernel_scalar;
+    }
+}
+
+// Hash + LenSum form of each kernel; the asm loop only produces the hash.
+inline pattern_sum_fn pattern_sum_function(PatternKernel kernel) {
+    switch (kernel) {
+#ifdef PATTERN_X86_64
+    case PatternKernel::SSE2:   return pattern_sum_sse2;
+    case PatternKernel::AVX2:   return pattern_sum_avx2;
+    case PatternKernel::AVX512: return pattern_sum_avx512;
+#endif
+    default:                    return pattern_sum_scalar;
+    }
+}
+
+inline PatternKernel pattern_kernel_from_env() {
+    const char* name = std::getenv("PATTERN_HASH_KERNEL");
+    if (name != nullptr) {
+        for (PatternKernel k : {PatternKernel::Asm, PatternKernel::Scalar, PatternKernel::SSE2,
+                                PatternKernel::AVX2, PatternKernel::AVX512})
+            if (std::strcmp(name, pattern_kernel_name(k)) == 0 && pattern_kernel_supported(k))
+                return k;
+    }
+    return pattern_best_kernel();
+}
+
+struct PatternDispatch {
+    std::atomic<PatternKernel> kernel;
+    std::atomic<pattern_kernel_fn> fn;
+    std::atomic<pattern_sum_fn> sum_fn;
+    PatternDispatch()
+        : kernel(pattern_kernel_from_env()),
+          fn(pattern_kernel_function(kernel.load())),
+          sum_fn(pattern_sum_function(kernel.load())) {}
+};
+
+inline PatternDispatch& pattern_dispatch() {
+    static PatternDispatch dispatch;
+    return dispatch;
+}
+
+inline PatternKernel pattern_active_kernel() {
+    return pattern_dispatch().kernel.load(std::memory_order_relaxed);
+}
+
+// Force a kernel (Auto restores detection). Returns false if the CPU lacks it.
+inline bool pattern_set_kernel(PatternKernel kernel) {
+    if (!pattern_kernel_supported(kernel))
+        return false;
+    if (kernel == PatternKernel::Auto)
+        kernel = pattern_best_kernel();
+    PatternDispatch& d = pattern_dispatch();
+    d.kernel.store(kernel, std::memory_order_relaxed);
+    d.fn.store(pattern_kernel_function(kernel), std::memory_order_relaxed);
+    d.sum_fn.store(pattern_sum_function(kernel), std::memory_order_relaxed);
+    return true;
+}
+
+// 32-bit hash: low half of the 64-bit accumulator, exactly as the asm kernel
+uint32_t hash_function_32(const char* str, size_t len) {
+    return static_cast<uint32_t>(pattern_dispatch().fn.load(std::memory_order_relaxed)(str, len));
+}
+
+// 64-bit hash through the selected kernel
+uint64_t hash_function_64(const char* str, size_t len) {
+    return pattern_dispatch().fn.load(std::memory_order_relaxed)(str, len);
+}
+
+// Hashes every key into out[i], matching hash_function_64 key for key. Under
+// the AVX2 and AVX-512 kernels, keys of up to 64 bytes are hashed eight at a
+// time across vector lanes; other kernels hash the keys one by one.
+inline void hash_many(std::span<const std::string_view> keys, uint64_t* out) {
+    switch (pattern_active_kernel()) {
+#ifdef PATTERN_X86_64
+    case PatternKernel::AVX2:   hash_many_avx2(keys.data(), keys.size(), out); return;
+    case PatternKernel::AVX512: hash_many_avx512(keys.data(), keys.size(), out); return;
+#endif
+    default: {
+        pattern_kernel_fn fn = pattern_dispatch().fn.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < keys.size(); ++i)
+            out[i] = fn(keys[i].data(), keys[i].size());
+    }
+    }
+}
+
+// Len of a single byte modulo 2^64 ('*' is the all-ones word).
+inline uint64_t pattern_len_64(unsigned char c) {
+    return 1 + static_cast<uint64_t>(pattern_delta(c));
+}
+
+// Summary of a byte range that is enough to place it anywhere in a larger
+// input: H is linear in position, so shifting a segment right by k bytes adds
+// k * LenSum to its hash, and H(a || b) = H(a) + H(b) + |a| * LenSum(b).
+struct PatternSegment {
+    uint64_t hash = 0;
+    uint64_t len_sum = 0;
+    uint64_t length = 0;
+
+    PatternSegment& append(const PatternSegment& next) {
+        hash += next.hash + length * next.len_sum;
+        len_sum += next.len_sum;
+        length += next.length;
+        return *this;
+    }
+};
+
+inline PatternSegment pattern_segment(const char* str, size_t len) {
+    PatternSum sum = pattern_dispatch().sum_fn.load(std::memory_order_relaxed)(str, len);
+    return {sum.hash, sum.len_sum, len};
+}
 
 std::string generate_random_string(size_t length) {
     const std::string charset = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!@#$%^&*()";